@@ -7,15 +7,41 @@
 #include <jansson.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <termios.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef HAVE_HDF5
+#include <hdf5.h>
+#endif
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-// LSZH (Zurich Airport) coordinates
-#define LSZH_LAT 47.458056
-#define LSZH_LON 8.548056
-#define RANGE_NM 20.0
+// Default view: LSZH (Zurich Airport), 20 nm to the screen edge
+#define DEFAULT_AIRPORT "LSZH"
+#define DEFAULT_RANGE_NM 20.0
+#define MAX_RANGE_NM 250.0
 #define EARTH_RADIUS_NM 3440.065  // Earth radius in nautical miles
 
 // ANSI color codes for weather radar
@@ -28,6 +54,30 @@
 #define COLOR_RED     "\033[38;5;196m"     // Extreme rain (>40 mm/h)
 #define COLOR_MAGENTA "\033[38;5;201m"     // Hail
 
+// Phosphor afterglow behind the sweep, by band (1 = faintest)
+#define COLOR_GLOW1   "\033[38;5;22m"
+#define COLOR_GLOW2   "\033[38;5;28m"
+#define COLOR_GLOW3   "\033[38;5;34m"
+
+// Airspace, runway and navaid overlay
+#define COLOR_OVERLAY "\033[38;5;244m"
+
+// Basic 16-color fallbacks for slow links (shorter escape sequences)
+#define COLOR16_BLUE    "\033[34m"
+#define COLOR16_CYAN    "\033[36m"
+#define COLOR16_GREEN   "\033[32m"
+#define COLOR16_YELLOW  "\033[93m"
+#define COLOR16_ORANGE  "\033[33m"
+#define COLOR16_RED     "\033[31m"
+#define COLOR16_OVERLAY "\033[90m"
+
+// Color depth used for weather shading
+typedef enum {
+	DEPTH_256 = 0,   // 256-color palette with block glyphs
+	DEPTH_16 = 1,    // basic ANSI colors
+	DEPTH_MONO = 2   // no color, ASCII glyphs only
+} ColorDepth;
+
 // Weather intensity levels
 typedef enum {
 	WEATHER_NONE = 0,
@@ -44,24 +94,169 @@ typedef struct {
 	int height;     // Number of rows (vertical)
 	int width;      // Number of columns (horizontal)
 	char **data;
-	WeatherIntensity **weather;  // Weather intensity at each position
+	WeatherIntensity **weather;  // Weather intensity at each position, rows of one block
+	char **trail;   // Trail dot at each position, ' ' when none
 } Matrix;
 
 // Aircraft structure
 typedef struct {
 	char callsign[16];
+	uint32_t icao24;    // ICAO 24-bit transponder address
+	int64_t timestamp;  // unix time of the position report
 	double latitude;
 	double longitude;
 	double altitude;    // in meters
 	double velocity;    // in m/s
+	double track;       // true track in degrees, -1 when unknown
 	int squawk;
-	double distance;    // distance from LSZH in nm
+	double distance;    // distance from the view center in nm
 } Aircraft;
 
+// Simulated weather cell, positioned in nautical miles east/north of the view center
+typedef struct {
+	double x_nm;
+	double y_nm;
+	double radius_nm;
+	WeatherIntensity intensity;
+} WeatherCell;
+
+#define MAX_WEATHER_CELLS 8
+
+typedef struct {
+	int count;
+	WeatherCell cells[MAX_WEATHER_CELLS];
+} WeatherField;
+
+// Bump allocator for per-poll data (response body, JSON DOM, aircraft list).
+// Everything is released at once by arena_reset(); after the first few polls
+// the chunk is large enough and a poll makes no heap calls at all.
+typedef struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t size;
+	size_t used;
+	max_align_t data[];
+} ArenaChunk;
+
+typedef struct {
+	ArenaChunk *chunks;    // current chunk first
+	void *last;            // most recent allocation, can grow in place
+	size_t high_water;     // total bytes used before the last reset
+	size_t heap_calls;     // chunk mallocs since creation
+} Arena;
+
+#define ARENA_MIN_CHUNK (256 * 1024)
+#define ARENA_ALIGN 16
+
+static size_t arena_round(size_t n) {
+	return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static ArenaChunk *arena_new_chunk(Arena *arena, size_t min_size) {
+	size_t size = ARENA_MIN_CHUNK;
+	while (size < min_size) {
+		size *= 2;
+	}
+	ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size);
+	if (!chunk) {
+		return NULL;
+	}
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->heap_calls++;
+	return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+	size = arena_round(size ? size : 1);
+
+	ArenaChunk *chunk = arena->chunks;
+	if (!chunk || chunk->used + size > chunk->size) {
+		chunk = arena_new_chunk(arena, size);
+		if (!chunk) {
+			return NULL;
+		}
+	}
+
+	void *ptr = (char *)chunk->data + chunk->used;
+	chunk->used += size;
+	arena->last = ptr;
+	return ptr;
+}
+
+// Grow an allocation; the most recent one is extended in place when it fits
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size) {
+	ArenaChunk *chunk = arena->chunks;
+
+	if (ptr && ptr == arena->last) {
+		size_t offset = (char *)ptr - (char *)chunk->data;
+		if (offset + arena_round(new_size) <= chunk->size) {
+			chunk->used = offset + arena_round(new_size);
+			return ptr;
+		}
+	}
+
+	void *fresh = arena_alloc(arena, new_size);
+	if (fresh && ptr) {
+		memcpy(fresh, ptr, old_size < new_size ? old_size : new_size);
+	}
+	return fresh;
+}
+
+// Release everything; chunks from a poll that overflowed are merged into one
+void arena_reset(Arena *arena) {
+	size_t total = 0;
+	int count = 0;
+	for (ArenaChunk *c = arena->chunks; c; c = c->next) {
+		total += c->used;
+		count++;
+	}
+	arena->high_water = total;
+	arena->last = NULL;
+
+	if (count > 1) {
+		size_t wanted = 0;
+		for (ArenaChunk *c = arena->chunks; c; c = c->next) {
+			wanted += c->size;
+		}
+		while (arena->chunks) {
+			ArenaChunk *next = arena->chunks->next;
+			free(arena->chunks);
+			arena->chunks = next;
+		}
+		arena_new_chunk(arena, wanted);
+	} else if (arena->chunks) {
+		arena->chunks->used = 0;
+	}
+}
+
+void arena_free_all(Arena *arena) {
+	while (arena->chunks) {
+		ArenaChunk *next = arena->chunks->next;
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+	arena->last = NULL;
+}
+
+// jansson allocation hooks; they have no user pointer, so the arena is global
+// and only installed for the duration of a parse
+static Arena *json_arena;
+
+static void *json_arena_malloc(size_t size) {
+	return arena_alloc(json_arena, size);
+}
+
+static void json_arena_free(void *ptr) {
+	(void)ptr;  // released with the arena
+}
+
 // Structure for API response
 struct MemoryStruct {
 	char *memory;
 	size_t size;
+	Arena *arena;   // grow inside this arena instead of the heap when set
 };
 
 // Callback function for curl
@@ -69,7 +264,12 @@ static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, voi
 	size_t realsize = size * nmemb;
 	struct MemoryStruct *mem = (struct MemoryStruct *)userp;
 
-	char *ptr = realloc(mem->memory, mem->size + realsize + 1);
+	char *ptr;
+	if (mem->arena) {
+		ptr = arena_realloc(mem->arena, mem->memory, mem->size + 1, mem->size + realsize + 1);
+	} else {
+		ptr = realloc(mem->memory, mem->size + realsize + 1);
+	}
 	if(!ptr) {
 		printf("Not enough memory!\n");
 		return 0;
@@ -98,38 +298,199 @@ double calculate_distance(double lat1, double lon1, double lat2, double lon2) {
 	return EARTH_RADIUS_NM * c;
 }
 
-// Create a visually square matrix
-Matrix* create_square_matrix(int n) {
-	Matrix *matrix = malloc(sizeof(Matrix));
+// Airports the view can be centered on (aerodrome reference points)
+typedef struct {
+	const char *icao;
+	const char *name;
+	double lat;
+	double lon;
+} Airport;
 
-	// Compensate for character aspect ratio
-	matrix->height = n;
-	matrix->width = n * 2;
+static const Airport airports[] = {
+	{"LSZH", "Zurich Airport", 47.458056, 8.548056},
+	{"LSGG", "Geneva Airport", 46.238333, 6.109167},
+	{"LFSB", "EuroAirport Basel-Mulhouse", 47.590000, 7.529444},
+	{"LSZB", "Bern Airport", 46.913889, 7.499167},
+	{"LSZA", "Lugano Airport", 46.003889, 8.910278},
+	{"LSZS", "Samedan Airport", 46.534444, 9.883889},
+	{"LSZR", "St. Gallen-Altenrhein Airport", 47.485278, 9.560833},
+	{"LSMP", "Payerne Air Base", 46.843611, 6.914722},
+	{"LSZC", "Buochs Airport", 46.974444, 8.396944},
+	{"EDDM", "Munich Airport", 48.353889, 11.786111},
+	{"EDDF", "Frankfurt Airport", 50.033333, 8.570556},
+	{"EDNY", "Friedrichshafen Airport", 47.671389, 9.511389},
+	{"LOWW", "Vienna Airport", 48.110278, 16.569722},
+	{"LIMC", "Milan Malpensa Airport", 45.630000, 8.723056},
+	{"LFPG", "Paris Charles de Gaulle Airport", 49.009722, 2.547778},
+	{"LFLL", "Lyon-Saint Exupery Airport", 45.725556, 5.081111},
+	{"EHAM", "Amsterdam Schiphol Airport", 52.308056, 4.763889},
+	{"EGLL", "London Heathrow Airport", 51.477500, -0.461389},
+};
 
-	matrix->data = malloc(matrix->height * sizeof(char*));
-	matrix->weather = malloc(matrix->height * sizeof(WeatherIntensity*));
-	for (int i = 0; i < matrix->height; i++) {
-		matrix->data[i] = malloc(matrix->width * sizeof(char));
-		matrix->weather[i] = malloc(matrix->width * sizeof(WeatherIntensity));
-		for (int j = 0; j < matrix->width; j++) {
-			matrix->data[i][j] = ' ';
-			matrix->weather[i][j] = WEATHER_NONE;
+// Center and range of the picture. The projection is azimuthal
+// equidistant about the center, so bearing and distance from the airport
+// are true at any range; the trigonometry of the center is kept here so
+// projecting a point costs one sin/cos pair of its own.
+typedef struct {
+	char icao[8];
+	char name[48];
+	double lat;
+	double lon;
+	double range_nm;
+	double sin_lat;
+	double cos_lat;
+} View;
+
+static View view;
+
+// Center the view on an ICAO code from the table or on "LAT,LON"
+int view_init(const char *where, double range_nm) {
+	double lat = 0, lon = 0;
+	char *end;
+
+	if (range_nm <= 0 || range_nm > MAX_RANGE_NM) {
+		fprintf(stderr, "Range must be between 0 and %.0f nm\n", MAX_RANGE_NM);
+		return -1;
+	}
+
+	memset(&view, 0, sizeof(view));
+	lat = strtod(where, &end);
+	if (end != where && *end == ',') {
+		const char *p = end + 1;
+		lon = strtod(p, &end);
+		if (end == p || *end || lat < -89 || lat > 89 || lon < -180 || lon > 180) {
+			fprintf(stderr, "Invalid position '%s' (expected LAT,LON)\n", where);
+			return -1;
+		}
+		snprintf(view.icao, sizeof(view.icao), "CUSTOM");
+		snprintf(view.name, sizeof(view.name), "%.4f, %.4f", lat, lon);
+	} else {
+		const Airport *airport = NULL;
+		for (size_t i = 0; i < sizeof(airports) / sizeof(airports[0]); i++) {
+			if (strcasecmp(where, airports[i].icao) == 0) {
+				airport = &airports[i];
+				break;
+			}
+		}
+		if (!airport) {
+			fprintf(stderr, "Unknown airport '%s'; known:", where);
+			for (size_t i = 0; i < sizeof(airports) / sizeof(airports[0]); i++) {
+				fprintf(stderr, " %s", airports[i].icao);
+			}
+			fprintf(stderr, " (or give LAT,LON)\n");
+			return -1;
 		}
+		lat = airport->lat;
+		lon = airport->lon;
+		snprintf(view.icao, sizeof(view.icao), "%s", airport->icao);
+		snprintf(view.name, sizeof(view.name), "%s", airport->name);
 	}
 
-	return matrix;
+	view.lat = lat;
+	view.lon = lon;
+	view.range_nm = range_nm;
+	view.sin_lat = sin(lat * M_PI / 180.0);
+	view.cos_lat = cos(lat * M_PI / 180.0);
+	return 0;
+}
+
+// Nautical miles east and north of the view center (azimuthal equidistant)
+void project(double lat, double lon, double *x_nm, double *y_nm) {
+	double phi = lat * M_PI / 180.0;
+	double dlon = (lon - view.lon) * M_PI / 180.0;
+	double sin_phi = sin(phi), cos_phi = cos(phi);
+	double sin_dlon = sin(dlon), cos_dlon = cos(dlon);
+
+	// Direction scaled by sin(c), c the angular distance from the center
+	double x = cos_phi * sin_dlon;
+	double y = view.cos_lat * sin_phi - view.sin_lat * cos_phi * cos_dlon;
+	double cos_c = view.sin_lat * sin_phi + view.cos_lat * cos_phi * cos_dlon;
+	double sin_c = sqrt(x * x + y * y);
+	double k = (sin_c > 1e-12) ? atan2(sin_c, cos_c) / sin_c : 1.0;
+
+	*x_nm = EARTH_RADIUS_NM * k * x;
+	*y_nm = EARTH_RADIUS_NM * k * y;
+}
+
+// Inverse of project()
+void unproject(double x_nm, double y_nm, double *lat, double *lon) {
+	double rho = sqrt(x_nm * x_nm + y_nm * y_nm);
+	if (rho < 1e-9) {
+		*lat = view.lat;
+		*lon = view.lon;
+		return;
+	}
+
+	double c = rho / EARTH_RADIUS_NM;
+	double sin_c = sin(c), cos_c = cos(c);
+	*lat = asin(cos_c * view.sin_lat + y_nm * sin_c * view.cos_lat / rho) * 180.0 / M_PI;
+	*lon = view.lon + atan2(x_nm * sin_c, rho * view.cos_lat * cos_c - y_nm * view.sin_lat * sin_c) * 180.0 / M_PI;
+	if (*lon > 180.0) *lon -= 360.0;
+	if (*lon < -180.0) *lon += 360.0;
 }
 
 void free_matrix(Matrix *matrix) {
 	for (int i = 0; i < matrix->height; i++) {
 		free(matrix->data[i]);
-		free(matrix->weather[i]);
+		free(matrix->trail[i]);
 	}
+	free(matrix->weather[0]);
 	free(matrix->data);
 	free(matrix->weather);
+	free(matrix->trail);
 	free(matrix);
 }
 
+// Create a matrix of the given size in character cells; NULL when out of memory
+Matrix* create_matrix(int height, int width) {
+	Matrix *matrix = malloc(sizeof(Matrix));
+	if (!matrix) {
+		return NULL;
+	}
+
+	matrix->height = height;
+	matrix->width = width;
+
+	// Row arrays start out NULL so free_matrix can undo a partial allocation
+	matrix->data = calloc(matrix->height, sizeof(char*));
+	matrix->weather = calloc(matrix->height, sizeof(WeatherIntensity*));
+	matrix->trail = calloc(matrix->height, sizeof(char*));
+	// The weather layer is one block so a finished layer can be swapped in whole
+	WeatherIntensity *cells = malloc((size_t)matrix->width * matrix->height * sizeof(WeatherIntensity));
+	if (!matrix->data || !matrix->weather || !matrix->trail || !cells) {
+		free(matrix->data);
+		free(matrix->weather);
+		free(matrix->trail);
+		free(cells);
+		free(matrix);
+		return NULL;
+	}
+	for (int i = 0; i < matrix->height; i++) {
+		matrix->weather[i] = cells + (size_t)i * matrix->width;
+	}
+	for (int i = 0; i < matrix->height; i++) {
+		matrix->data[i] = malloc(matrix->width * sizeof(char));
+		matrix->trail[i] = malloc(matrix->width * sizeof(char));
+		if (!matrix->data[i] || !matrix->trail[i]) {
+			free_matrix(matrix);
+			return NULL;
+		}
+		for (int j = 0; j < matrix->width; j++) {
+			matrix->data[i][j] = ' ';
+			matrix->weather[i][j] = WEATHER_NONE;
+			matrix->trail[i][j] = ' ';
+		}
+	}
+
+	return matrix;
+}
+
+// Create a visually square matrix
+Matrix* create_square_matrix(int n) {
+	// Compensate for character aspect ratio
+	return create_matrix(n, n * 2);
+}
+
 // Get color code for weather intensity
 const char* get_weather_color(WeatherIntensity intensity) {
 	switch(intensity) {
@@ -143,6 +504,32 @@ const char* get_weather_color(WeatherIntensity intensity) {
 	}
 }
 
+// Basic ANSI color for weather intensity
+const char* get_weather_color16(WeatherIntensity intensity) {
+	switch(intensity) {
+		case WEATHER_LIGHT: return COLOR16_BLUE;
+		case WEATHER_MODERATE: return COLOR16_CYAN;
+		case WEATHER_HEAVY: return COLOR16_GREEN;
+		case WEATHER_VERY_HEAVY: return COLOR16_YELLOW;
+		case WEATHER_INTENSE: return COLOR16_ORANGE;
+		case WEATHER_EXTREME: return COLOR16_RED;
+		default: return "";
+	}
+}
+
+// Single-byte weather character for monochrome output
+const char* get_weather_char_ascii(WeatherIntensity intensity) {
+	switch(intensity) {
+		case WEATHER_LIGHT: return ".";
+		case WEATHER_MODERATE: return ":";
+		case WEATHER_HEAVY: return "-";
+		case WEATHER_VERY_HEAVY: return "=";
+		case WEATHER_INTENSE: return "#";
+		case WEATHER_EXTREME: return "@";
+		default: return " ";
+	}
+}
+
 // Get weather character based on intensity (returns UTF-8 string)
 const char* get_weather_char(WeatherIntensity intensity) {
 	switch(intensity) {
@@ -156,313 +543,1405 @@ const char* get_weather_char(WeatherIntensity intensity) {
 	}
 }
 
+// Screen rows per nautical mile so that the view range fits the smaller screen dimension
+double screen_scale(int width, int height) {
+	int half = (width / 4 < height / 2) ? width / 4 : height / 2;
+	return half / view.range_nm;
+}
+
+// Position of point (x, y) of the weather layer, x in columns; integer
+// coordinates are the cell positions the weather raster samples
+void screen_point_to_latlon(double x, double y, int width, int height, double *lat, double *lon) {
+	double scale = screen_scale(width, height);
+	double x_nm = (x / 2.0 - width / 4) / scale;
+	double y_nm = (height / 2 - y) / scale;
+
+	unproject(x_nm, y_nm, lat, lon);
+}
+
 // Fetch weather radar data from MeteoSwiss/Existenz API (simplified)
 // This uses the free existenz.ch API which aggregates MeteoSwiss data
-int fetch_weather_data(Matrix *matrix) {
+int fetch_weather_data(WeatherField *field) {
 	// For demonstration, we'll create a simple pattern
 	// In production, you would fetch from: https://api.existenz.ch/apiv1/smn/...
 	// Or parse MeteoSwiss STAC API radar data
 	
 	// Create a simple simulated weather pattern around Zurich
-	int center_x = matrix->width / 4;  // Center of display
-	int center_y = matrix->height / 2;
-	
-	// Add some random weather cells
+	// Cells are kept in nautical miles from the center so they survive a resize
 	srand(time(NULL));
-	int num_cells = 3 + (rand() % 5);  // 3-7 weather cells
+	field->count = 3 + (rand() % 5);  // 3-7 weather cells
 	
-	for (int cell = 0; cell < num_cells; cell++) {
+	for (int cell = 0; cell < field->count; cell++) {
 		// Random position within range
-		int cell_x = center_x - 30 + (rand() % 60);
-		int cell_y = center_y - 30 + (rand() % 60);
-		int radius = 5 + (rand() % 15);
-		WeatherIntensity intensity = 1 + (rand() % 5);  // Random intensity
-		
+		field->cells[cell].x_nm = -10.0 + (rand() % 60) / 3.0;
+		field->cells[cell].y_nm = -10.0 + (rand() % 60) / 3.0;
+		field->cells[cell].radius_nm = (5 + (rand() % 15)) / 3.0;
+		field->cells[cell].intensity = 1 + (rand() % 5);  // Random intensity
+	}
+	
+	return 0;
+}
+
+// Install a width * height weather block in the matrix; returns the block it replaces
+WeatherIntensity *matrix_swap_weather(Matrix *matrix, WeatherIntensity *cells) {
+	WeatherIntensity *old = matrix->weather[0];
+	for (int i = 0; i < matrix->height; i++) {
+		matrix->weather[i] = cells + (size_t)i * matrix->width;
+	}
+	return old;
+}
+
+// Rasterize simulated weather cells into a width * height layer, replacing
+// whatever it held before
+void rasterize_weather(WeatherIntensity *layer, int width, int height, const WeatherField *field) {
+	int center_x = width / 4;  // Center of display
+	int center_y = height / 2;
+	double scale = screen_scale(width, height);
+
+	memset(layer, 0, (size_t)width * height * sizeof(WeatherIntensity));  // WEATHER_NONE
+
+	for (int cell = 0; cell < field->count; cell++) {
+		const WeatherCell *wc = &field->cells[cell];
+		double cell_x = center_x + wc->x_nm * scale;
+		double cell_y = center_y - wc->y_nm * scale;
+		double radius = wc->radius_nm * scale;
+
+		// Only visit the bounding box of the cell
+		int y0 = (int)(cell_y - radius), y1 = (int)(cell_y + radius) + 1;
+		int x0 = (int)((cell_x - radius) * 2), x1 = (int)((cell_x + radius) * 2) + 1;
+		if (y0 < 0) y0 = 0;
+		if (y1 > height) y1 = height;
+		if (x0 < 0) x0 = 0;
+		if (x1 > width) x1 = width;
+
 		// Draw weather cell
-		for (int y = 0; y < matrix->height; y++) {
-			for (int x = 0; x < matrix->width; x++) {
-				int dx = x - cell_x * 2;  // Account for 2x width
-				int dy = y - cell_y;
+		for (int y = y0; y < y1; y++) {
+			for (int x = x0; x < x1; x++) {
+				double dx = x - cell_x * 2;  // Account for 2x width
+				double dy = y - cell_y;
 				double distance = sqrt(dx * dx / 4.0 + dy * dy);  // Elliptical
 				
 				if (distance < radius) {
 					// Intensity decreases with distance from center
 					double fade = 1.0 - (distance / radius);
-					WeatherIntensity cell_intensity = (WeatherIntensity)((int)(intensity * fade));
+					WeatherIntensity cell_intensity = (WeatherIntensity)((int)(wc->intensity * fade));
 					
-					if (cell_intensity > matrix->weather[y][x]) {
-						matrix->weather[y][x] = cell_intensity;
+					if (cell_intensity > layer[y * width + x]) {
+						layer[y * width + x] = cell_intensity;
 					}
 				}
 			}
 		}
 	}
-	
-	return 0;
 }
 
-// Alternative: Fetch real weather data from MeteoSwiss Open Data (commented out - requires HDF5 library)
-/*
-int fetch_meteoswiss_radar_data(Matrix *matrix) {
-	// MeteoSwiss provides radar data through STAC API
-	// Collection: ch.meteoschweiz.ccs4r2nj (Radar-based precipitation)
-	// Format: HDF5 files updated every 5 minutes
-	// API: https://data.geo.admin.ch/api/stac/v1/collections/ch.meteoschweiz.ogd-radar-rzc/items
-	
-	CURL *curl;
-	CURLcode res;
-	struct MemoryStruct chunk;
+void draw_weather_layer(Matrix *matrix, const WeatherField *field) {
+	rasterize_weather(matrix->weather[0], matrix->width, matrix->height, field);
+}
 
-	chunk.memory = malloc(1);
-	chunk.size = 0;
+// Outline mode: contours of the weather layer by marching squares. The
+// square between four neighbouring cells is classified against each contour
+// level and, when a contour crosses it, its cell gets the box-drawing glyph
+// of the crossing, coloured by the highest level that crosses there. The
+// outline layer has the form of the weather layer (band in the low bits,
+// glyph above), so the sweep reveals it cell by cell and only cells on a
+// contour are ever drawn. It is rebuilt only when the weather layer changes.
+#define OUTLINE_SHIFT 3
+#define OUTLINE_BAND(v) ((v) & ((1 << OUTLINE_SHIFT) - 1))
+#define OUTLINE_GLYPH(v) ((v) >> OUTLINE_SHIFT)
 
-	curl_global_init(CURL_GLOBAL_DEFAULT);
-	curl = curl_easy_init();
+enum { OUTLINE_NONE, OUTLINE_H, OUTLINE_V, OUTLINE_DR, OUTLINE_DL, OUTLINE_UR, OUTLINE_UL,
+       OUTLINE_RISE, OUTLINE_FALL, OUTLINE_GLYPHS };
 
-	if(!curl) {
-		fprintf(stderr, "Failed to initialize CURL\n");
-		return -1;
-	}
+static const WeatherIntensity outline_levels[] = {WEATHER_LIGHT, WEATHER_HEAVY, WEATHER_INTENSE};
 
-	// Get latest radar data item
-	char url[] = "https://data.geo.admin.ch/api/stac/v1/collections/ch.meteoschweiz.ogd-radar-rzc/items?limit=1";
+// Glyph by marching-squares case: bit 3 top left inside, 2 top right,
+// 1 bottom right, 0 bottom left; the saddles 5 and 10 are resolved apart
+static const uint8_t outline_case_glyph[16] = {
+	OUTLINE_NONE, OUTLINE_DL, OUTLINE_DR, OUTLINE_H, OUTLINE_UR, OUTLINE_NONE, OUTLINE_V, OUTLINE_UL,
+	OUTLINE_UL, OUTLINE_V, OUTLINE_NONE, OUTLINE_UR, OUTLINE_H, OUTLINE_DR, OUTLINE_DL, OUTLINE_NONE
+};
 
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, "aircraft-radar-display/1.0");
-	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+static const char *const outline_chars[OUTLINE_GLYPHS] = {" ", "─", "│", "╭", "╮", "╰", "╯", "╱", "╲"};
+static const char *const outline_chars_ascii[OUTLINE_GLYPHS] = {" ", "-", "|", ".", ".", "`", "'", "/", "\\"};
 
-	res = curl_easy_perform(curl);
+// Outline of a width * height weather layer into out, replacing its contents
+void outline_weather(WeatherIntensity *out, const WeatherIntensity *layer, int width, int height) {
+	const int levels = sizeof(outline_levels) / sizeof(outline_levels[0]);
 
-	if(res != CURLE_OK) {
-		fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-		curl_easy_cleanup(curl);
-		curl_global_cleanup();
-		free(chunk.memory);
-		return -1;
+	memset(out, 0, (size_t)width * height * sizeof(WeatherIntensity));  // WEATHER_NONE
+	for (int y = 0; y + 1 < height; y++) {
+		const WeatherIntensity *top = layer + (size_t)y * width;
+		const WeatherIntensity *bottom = top + width;
+		WeatherIntensity *row = out + (size_t)y * width;
+		for (int x = 0; x + 1 < width; x++) {
+			WeatherIntensity tl = top[x], tr = top[x + 1], br = bottom[x + 1], bl = bottom[x];
+			// Dry squares, the bulk of the screen, cross no contour
+			if ((tl | tr | br | bl) == WEATHER_NONE) {
+				continue;
+			}
+			for (int l = levels - 1; l >= 0; l--) {
+				WeatherIntensity level = outline_levels[l];
+				int c = (tl >= level) << 3 | (tr >= level) << 2 | (br >= level) << 1 | (bl >= level);
+				int glyph = outline_case_glyph[c];
+				if (c == 5 || c == 10) {
+					// Saddle: a wet center joins the wet corners, cutting off the dry ones
+					int center = 4 * (int)level <= (int)(tl + tr + br + bl);
+					glyph = (c == 5) == center ? OUTLINE_RISE : OUTLINE_FALL;
+				}
+				if (glyph != OUTLINE_NONE) {
+					row[x] = (WeatherIntensity)(level | glyph << OUTLINE_SHIFT);
+					break;
+				}
+			}
+		}
 	}
+}
 
-	curl_easy_cleanup(curl);
-	curl_global_cleanup();
+// Real radar composites in ODIM-HDF5, e.g. MeteoSwiss RZC (precipitation rate
+// on the Swiss CCS4 grid), read from a local directory. The field is decoded
+// a block of rows at a time straight into one band byte per pixel, so the raw
+// samples are never held whole.
+#define RADAR_BLOCK_ROWS 64   // rows per read when the dataset is not chunked
 
-	// Parse JSON to get HDF5 file URL
-	// Download and parse HDF5 file (requires libhdf5)
-	// Map radar data to matrix coordinates
-	
-	free(chunk.memory);
-	return 0;
-}
-*/
+// Decoded composite: one WeatherIntensity per source pixel, row 0 northernmost
+typedef struct {
+	uint8_t *band;
+	int xsize;
+	int ysize;
+	double xscale;          // metres per pixel
+	double yscale;
+	double ul_e;            // Swiss coordinates of the upper-left grid corner
+	double ul_n;
+	double false_e;         // +x_0/+y_0: LV03 or LV95 origin
+	double false_n;
+	char path[PATH_MAX];    // file the grid was decoded from
+	time_t mtime;
+	time_t time;            // nominal product time, the file mtime when it has none
+	uint8_t *pooled;        // band max-pooled to pooled_level, NULL until asked for
+	int pooled_level;
+} RadarGrid;
 
-// Display "X" at given coordinates
-void display_symbol(Matrix *matrix, int x, int y) {
-	int scaled_x = x * 2;
+// WGS84 to Swiss oblique Mercator with the swisstopo approximation (about 1 m)
+void swiss_project(double lat, double lon, double false_e, double false_n, double *e, double *n) {
+	double phi = (lat * 3600.0 - 169028.66) / 10000.0;
+	double lambda = (lon * 3600.0 - 26782.5) / 10000.0;
 
-	if (scaled_x >= 0 && scaled_x < matrix->width && y >= 0 && y < matrix->height) {
-		matrix->data[y][scaled_x] = 'X';
-	}
+	*e = false_e + 72.37 + 211455.93 * lambda - 10938.51 * lambda * phi
+	     - 0.36 * lambda * phi * phi - 44.54 * lambda * lambda * lambda;
+	*n = false_n + 147.07 + 308807.95 * phi + 3745.25 * lambda * lambda + 76.63 * phi * phi
+	     - 194.56 * lambda * lambda * phi + 119.79 * phi * phi * phi;
 }
 
-// Display "/" one line above and one position to the right
-void display_slash(Matrix *matrix, int x, int y) {
-	int scaled_x = (x + 1) * 2;
-	int slash_y = y - 1;
+void free_radar_grid(RadarGrid *grid) {
+	free(grid->band);
+	free(grid->pooled);
+	grid->band = NULL;
+	grid->pooled = NULL;
+}
 
-	if (scaled_x >= 0 && scaled_x < matrix->width && slash_y >= 0 && slash_y < matrix->height) {
-		matrix->data[slash_y][scaled_x] = '/';
+// One output row of a 2x2 max-pool from input rows a and b, from column x on
+static void maxpool2_row_scalar(uint8_t *out, const uint8_t *a, const uint8_t *b, int width, int x) {
+	for (; x < (width + 1) / 2; x++) {
+		int x0 = 2 * x;
+		int x1 = x0 + 1 < width ? x0 + 1 : x0;  // an odd last column pools alone
+		uint8_t m = a[x0] > a[x1] ? a[x0] : a[x1];
+		uint8_t n = b[x0] > b[x1] ? b[x0] : b[x1];
+		out[x] = m > n ? m : n;
 	}
 }
 
-// Display information text aligned with the slash
-void display_info(Matrix *matrix, int x, int y, const char *callsign, int altitude_ft, int speed_kts, double distance_nm) {
-	int slash_x = (x + 1) * 2;
-	int text_y = y - 5;
-
-	if (text_y >= 0 && text_y < matrix->height) {
-		char buffer[100];
-
-		// Callsign line
-		int tab_offset = slash_x;
-		snprintf(buffer, sizeof(buffer), "%.8s", callsign);
-		for (int i = 0; buffer[i] != '\0' && (tab_offset + i) < matrix->width; i++) {
-			matrix->data[text_y][tab_offset + i] = buffer[i];
-		}
-
-		// Altitude line
-		snprintf(buffer, sizeof(buffer), "Alt:%dft", altitude_ft);
-		for (int i = 0; buffer[i] != '\0' && (tab_offset + i) < matrix->width; i++) {
-			matrix->data[text_y + 1][tab_offset + i] = buffer[i];
-		}
+// Scalar reference for maxpool2()
+void maxpool2_scalar(uint8_t *dst, const uint8_t *src, int width, int height) {
+	int out_w = (width + 1) / 2;
+	for (int y = 0; y < (height + 1) / 2; y++) {
+		const uint8_t *a = src + (size_t)2 * y * width;
+		const uint8_t *b = 2 * y + 1 < height ? a + width : a;
+		maxpool2_row_scalar(dst + (size_t)y * out_w, a, b, width, 0);
+	}
+}
 
-		// Speed line
-		snprintf(buffer, sizeof(buffer), "Spd:%dkt", speed_kts);
-		for (int i = 0; buffer[i] != '\0' && (tab_offset + i) < matrix->width; i++) {
-			matrix->data[text_y + 2][tab_offset + i] = buffer[i];
+// Halve a band grid, each output the max of a 2x2 block; dst is
+// ceil(width / 2) x ceil(height / 2). Two rows are maxed bytewise, then
+// each 16-bit lane holds a horizontal pair whose bytes are maxed and packed.
+void maxpool2(uint8_t *dst, const uint8_t *src, int width, int height) {
+	int out_w = (width + 1) / 2;
+	for (int y = 0; y < (height + 1) / 2; y++) {
+		const uint8_t *a = src + (size_t)2 * y * width;
+		const uint8_t *b = 2 * y + 1 < height ? a + width : a;
+		uint8_t *out = dst + (size_t)y * out_w;
+		int x = 0;
+#if defined(__AVX2__)
+		const __m256i low = _mm256_set1_epi16(0x00FF);
+		for (; 2 * x + 64 <= width; x += 32) {
+			__m256i v0 = _mm256_max_epu8(_mm256_loadu_si256((const __m256i *)(a + 2 * x)),
+			                             _mm256_loadu_si256((const __m256i *)(b + 2 * x)));
+			__m256i v1 = _mm256_max_epu8(_mm256_loadu_si256((const __m256i *)(a + 2 * x + 32)),
+			                             _mm256_loadu_si256((const __m256i *)(b + 2 * x + 32)));
+			v0 = _mm256_max_epi16(_mm256_and_si256(v0, low), _mm256_srli_epi16(v0, 8));
+			v1 = _mm256_max_epi16(_mm256_and_si256(v1, low), _mm256_srli_epi16(v1, 8));
+			// The pack works per 128-bit half, so put the quarters back in order
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v0, v1), 0xD8);
+			_mm256_storeu_si256((__m256i *)(out + x), packed);
 		}
-
-		// Distance line
-		snprintf(buffer, sizeof(buffer), "Dst:%.1fnm", distance_nm);
-		for (int i = 0; buffer[i] != '\0' && (tab_offset + i) < matrix->width; i++) {
-			matrix->data[text_y + 3][tab_offset + i] = buffer[i];
+#endif
+#ifdef __SSE2__
+		const __m128i low16 = _mm_set1_epi16(0x00FF);
+		for (; 2 * x + 32 <= width; x += 16) {
+			__m128i v0 = _mm_max_epu8(_mm_loadu_si128((const __m128i *)(a + 2 * x)),
+			                          _mm_loadu_si128((const __m128i *)(b + 2 * x)));
+			__m128i v1 = _mm_max_epu8(_mm_loadu_si128((const __m128i *)(a + 2 * x + 16)),
+			                          _mm_loadu_si128((const __m128i *)(b + 2 * x + 16)));
+			v0 = _mm_max_epi16(_mm_and_si128(v0, low16), _mm_srli_epi16(v0, 8));
+			v1 = _mm_max_epi16(_mm_and_si128(v1, low16), _mm_srli_epi16(v1, 8));
+			_mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(v0, v1));
 		}
+#endif
+		maxpool2_row_scalar(out, a, b, width, x);
 	}
 }
 
-void clear_matrix(Matrix *matrix) {
-	for (int i = 0; i < matrix->height; i++) {
-		for (int j = 0; j < matrix->width; j++) {
-			matrix->data[i][j] = ' ';
-			matrix->weather[i][j] = WEATHER_NONE;
-		}
+// The band grid max-pooled `level` times, computed once per composite and
+// level; NULL when out of memory
+const uint8_t *radar_pool(RadarGrid *grid, int level) {
+	if (level == 0) {
+		return grid->band;
+	}
+	if (grid->pooled && grid->pooled_level == level) {
+		return grid->pooled;
+	}
+
+	// Ping-pong between two buffers the size of the first level
+	size_t first = (size_t)((grid->xsize + 1) / 2) * ((grid->ysize + 1) / 2);
+	uint8_t *buf[2] = {malloc(first), malloc(first)};
+	if (!buf[0] || !buf[1]) {
+		free(buf[0]);
+		free(buf[1]);
+		return NULL;
+	}
+	const uint8_t *src = grid->band;
+	int w = grid->xsize, h = grid->ysize;
+	for (int l = 1; l <= level; l++) {
+		maxpool2(buf[l & 1], src, w, h);
+		src = buf[l & 1];
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
 	}
+	free(buf[(level + 1) & 1]);
+	free(grid->pooled);
+	grid->pooled = buf[level & 1];
+	grid->pooled_level = level;
+	return grid->pooled;
 }
 
-// Sonar sweep update - progressively reveals the source matrix with a sweeping effect
-void sonar_sweep_update(Matrix *dest, Matrix *source) {
-	int center_x = dest->width / 2;
-	int center_y = dest->height / 2;
-	
-	int max_radius = (int)sqrt(center_x * center_x + center_y * center_y) + 1;
-	int num_angles = 720;
-	int usleep_per_angle = 7000;
-	
-	for (int angle_step = 0; angle_step < num_angles; angle_step++) {
-		double theta = (angle_step * 2 * M_PI) / num_angles;
-		
-		for (int radius = 0; radius <= max_radius; radius++) {
-			int x = center_x + (int)(radius * cos(theta));
-			int y = center_y + (int)(radius * sin(theta));
-			
-			if (x >= 0 && x < dest->width && y >= 0 && y < dest->height) {
-				dest->data[y][x] = source->data[y][x];
-				dest->weather[y][x] = source->weather[y][x];
-			}
-		}
-		
-		int ret = system("clear");
-		(void)ret;
-		
-		// Print with weather overlay
-		for (int i = 0; i < dest->height; i++) {
-			for (int j = 0; j < dest->width; j++) {
-				// If there's aircraft data, display it (white)
-				if (dest->data[i][j] != ' ') {
-					printf("%s%c%s", COLOR_RESET, dest->data[i][j], COLOR_RESET);
-				}
-				// Otherwise show weather if present
-				else if (dest->weather[i][j] != WEATHER_NONE) {
-					const char *color = get_weather_color(dest->weather[i][j]);
-					const char *weather_char = get_weather_char(dest->weather[i][j]);
-					printf("%s%s%s", color, weather_char, COLOR_RESET);
-				}
-				// Otherwise show blank space
-				else {
-					printf(" ");
-				}
-			}
-			printf("\n");
-		}
-		fflush(stdout);
-		
-		usleep(usleep_per_angle);
+#ifdef HAVE_HDF5
+// Rain rate (mm/h) at the bottom of each WeatherIntensity band, as in the legend
+static const double rain_band_rate[WEATHER_EXTREME] = {0.5, 2, 5, 10, 20, 40};
+
+static int odim_attr_double(hid_t file, const char *group, const char *name, double *value) {
+	if (H5Aexists_by_name(file, group, name, H5P_DEFAULT) <= 0) {
+		return -1;
+	}
+	hid_t attr = H5Aopen_by_name(file, group, name, H5P_DEFAULT, H5P_DEFAULT);
+	if (attr < 0) {
+		return -1;
 	}
+	herr_t err = H5Aread(attr, H5T_NATIVE_DOUBLE, value);
+	H5Aclose(attr);
+	return err < 0 ? -1 : 0;
 }
 
-// Print matrix with weather overlay
-void print_matrix(Matrix *matrix) {
-	int ret = system("clear");
-	(void)ret;
+// String attribute, fixed or variable length
+static int odim_attr_string(hid_t file, const char *group, const char *name, char *buf, size_t len) {
+	if (H5Aexists_by_name(file, group, name, H5P_DEFAULT) <= 0) {
+		return -1;
+	}
+	hid_t attr = H5Aopen_by_name(file, group, name, H5P_DEFAULT, H5P_DEFAULT);
+	if (attr < 0) {
+		return -1;
+	}
+	hid_t type = H5Aget_type(attr);
+	hid_t mem = H5Tcopy(H5T_C_S1);
+	int ret = -1;
 
-	for (int i = 0; i < matrix->height; i++) {
-		for (int j = 0; j < matrix->width; j++) {
-			// If there's aircraft data, display it (white)
-			if (matrix->data[i][j] != ' ') {
-				printf("%s%c%s", COLOR_RESET, matrix->data[i][j], COLOR_RESET);
-			}
-			// Otherwise show weather if present
-			else if (matrix->weather[i][j] != WEATHER_NONE) {
-				const char *color = get_weather_color(matrix->weather[i][j]);
-				const char *weather_char = get_weather_char(matrix->weather[i][j]);
-				printf("%s%s%s", color, weather_char, COLOR_RESET);
-			}
-			// Otherwise show blank space
-			else {
-				printf(" ");
-			}
+	if (H5Tis_variable_str(type) > 0) {
+		char *str = NULL;
+		H5Tset_size(mem, H5T_VARIABLE);
+		if (H5Aread(attr, mem, &str) >= 0 && str) {
+			snprintf(buf, len, "%s", str);
+			ret = 0;
 		}
-		printf("\n");
+		H5free_memory(str);
+	} else {
+		size_t size = H5Tget_size(type) + 1;
+		char *str = malloc(size);
+		H5Tset_size(mem, size);
+		H5Tset_strpad(mem, H5T_STR_NULLTERM);
+		if (str && H5Aread(attr, mem, str) >= 0) {
+			snprintf(buf, len, "%s", str);
+			ret = 0;
+		}
+		free(str);
 	}
+	H5Tclose(mem);
+	H5Tclose(type);
+	H5Aclose(attr);
+	return ret;
 }
 
-// Convert lat/lon to screen coordinates
-void latlon_to_screen(double lat, double lon, int *screen_x, int *screen_y, int width, int height) {
-	double lat_diff = lat - LSZH_LAT;
-	double lon_diff = lon - LSZH_LON;
-
-	double y_nm = lat_diff * 60.0;
-	double x_nm = lon_diff * 60.0 * cos(LSZH_LAT * M_PI / 180.0);
+// ODIM "what" attribute, looked up on the data, then the dataset, then the file
+static int odim_what_double(hid_t file, const char *name, double *value) {
+	return odim_attr_double(file, "/dataset1/data1/what", name, value) == 0 ||
+	       odim_attr_double(file, "/dataset1/what", name, value) == 0 ||
+	       odim_attr_double(file, "/what", name, value) == 0 ? 0 : -1;
+}
 
-	*screen_x = (width / 4) + (int)(x_nm * (width / 4) / RANGE_NM);
-	*screen_y = (height / 2) - (int)(y_nm * (height / 2) / RANGE_NM);
+static int odim_what_string(hid_t file, const char *name, char *buf, size_t len) {
+	return odim_attr_string(file, "/dataset1/data1/what", name, buf, len) == 0 ||
+	       odim_attr_string(file, "/dataset1/what", name, buf, len) == 0 ||
+	       odim_attr_string(file, "/what", name, buf, len) == 0 ? 0 : -1;
+}
 
-	if (*screen_x < 0) *screen_x = 0;
-	if (*screen_x >= width / 2) *screen_x = (width / 2) - 1;
-	if (*screen_y < 6) *screen_y = 6;
-	if (*screen_y >= height) *screen_y = height - 1;
+// Numeric parameter of a PROJ definition, e.g. "+x_0=600000"
+static double proj_param(const char *projdef, const char *key, double fallback) {
+	const char *p = strstr(projdef, key);
+	return p ? atof(p + strlen(key)) : fallback;
 }
 
-// Fetch aircraft data from OpenSky Network API
-int fetch_aircraft_data(Aircraft **aircraft_list, int *count) {
-	CURL *curl;
-	CURLcode res;
-	struct MemoryStruct chunk;
+// Decode the first field of an ODIM-HDF5 composite into grid; grid is left
+// alone on error
+int radar_decode(const char *path, RadarGrid *grid) {
+	H5Eset_auto2(H5E_DEFAULT, NULL, NULL);  // errors are reported here instead
+	hid_t file = H5Fopen(path, H5F_ACC_RDONLY, H5P_DEFAULT);
+	if (file < 0) {
+		fprintf(stderr, "radar: cannot open %s\n", path);
+		return -1;
+	}
 
-	chunk.memory = malloc(1);
-	chunk.size = 0;
+	RadarGrid g;
+	memset(&g, 0, sizeof(g));
+	hid_t dset = -1, space = -1, dcpl = -1;
+	float *rows = NULL;
+	int ret = -1;
 
-	curl_global_init(CURL_GLOBAL_DEFAULT);
-	curl = curl_easy_init();
+	char projdef[256], quantity[32];
+	double ul_lat, ul_lon;
+	if (odim_attr_string(file, "/where", "projdef", projdef, sizeof(projdef)) < 0 ||
+	    odim_attr_double(file, "/where", "xscale", &g.xscale) < 0 ||
+	    odim_attr_double(file, "/where", "yscale", &g.yscale) < 0 ||
+	    odim_attr_double(file, "/where", "UL_lat", &ul_lat) < 0 ||
+	    odim_attr_double(file, "/where", "UL_lon", &ul_lon) < 0) {
+		fprintf(stderr, "radar: %s: missing /where attributes\n", path);
+		goto out;
+	}
+	// The swisstopo formulas are only valid for the Bern-centered projection
+	if (!strstr(projdef, "+proj=somerc") ||
+	    fabs(proj_param(projdef, "+lat_0=", 0) - 46.9524056) > 1e-3 ||
+	    fabs(proj_param(projdef, "+lon_0=", 0) - 7.4395833) > 1e-3) {
+		fprintf(stderr, "radar: %s: unsupported projection %s\n", path, projdef);
+		goto out;
+	}
+	char date[16], tod[16];
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+	if (odim_attr_string(file, "/what", "date", date, sizeof(date)) == 0 &&
+	    odim_attr_string(file, "/what", "time", tod, sizeof(tod)) == 0 &&
+	    sscanf(date, "%4d%2d%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday) == 3 &&
+	    sscanf(tod, "%2d%2d%2d", &tm.tm_hour, &tm.tm_min, &tm.tm_sec) == 3) {
+		tm.tm_year -= 1900;
+		tm.tm_mon -= 1;
+		g.time = timegm(&tm);
+	}
+	g.false_e = proj_param(projdef, "+x_0=", 600000);
+	g.false_n = proj_param(projdef, "+y_0=", 200000);
+	swiss_project(ul_lat, ul_lon, g.false_e, g.false_n, &g.ul_e, &g.ul_n);
 
-	if(!curl) {
-		fprintf(stderr, "Failed to initialize CURL\n");
-		return -1;
+	// Band edges in the units of the stored quantity
+	double edge[WEATHER_EXTREME];
+	if (odim_what_string(file, "quantity", quantity, sizeof(quantity)) < 0) {
+		fprintf(stderr, "radar: %s: no quantity\n", path);
+		goto out;
+	}
+	for (int b = 0; b < WEATHER_EXTREME; b++) {
+		if (strcmp(quantity, "RATE") == 0) {
+			edge[b] = rain_band_rate[b];
+		} else if (strcmp(quantity, "DBZH") == 0 || strcmp(quantity, "TH") == 0) {
+			edge[b] = 10.0 * log10(200.0 * pow(rain_band_rate[b], 1.6));  // Marshall-Palmer
+		} else {
+			fprintf(stderr, "radar: %s: unsupported quantity %s\n", path, quantity);
+			goto out;
+		}
 	}
+	double gain = 1, offset = 0, nodata = NAN, undetect = NAN;
+	odim_what_double(file, "gain", &gain);
+	odim_what_double(file, "offset", &offset);
+	odim_what_double(file, "nodata", &nodata);
+	odim_what_double(file, "undetect", &undetect);
 
-	double lat_range = RANGE_NM / 60.0;
-	double lon_range = RANGE_NM / (60.0 * cos(LSZH_LAT * M_PI / 180.0));
+	dset = H5Dopen2(file, "/dataset1/data1/data", H5P_DEFAULT);
+	space = dset >= 0 ? H5Dget_space(dset) : -1;
+	hsize_t dims[2];
+	if (space < 0 || H5Sget_simple_extent_ndims(space) != 2 ||
+	    H5Sget_simple_extent_dims(space, dims, NULL) < 0 || dims[0] == 0 || dims[1] == 0) {
+		fprintf(stderr, "radar: %s: no 2-D /dataset1/data1/data\n", path);
+		goto out;
+	}
+	g.ysize = (int)dims[0];
+	g.xsize = (int)dims[1];
 
-	char url[512];
-	snprintf(url, sizeof(url),
-	         "https://opensky-network.org/api/states/all?lamin=%.4f&lomin=%.4f&lamax=%.4f&lomax=%.4f",
-	         LSZH_LAT - lat_range, LSZH_LON - lon_range,
-	         LSZH_LAT + lat_range, LSZH_LON + lon_range);
+	// Read whole chunks when the file is chunked (and usually compressed)
+	hsize_t block = RADAR_BLOCK_ROWS;
+	dcpl = H5Dget_create_plist(dset);
+	if (H5Pget_layout(dcpl) == H5D_CHUNKED) {
+		hsize_t chunk[2];
+		if (H5Pget_chunk(dcpl, 2, chunk) == 2 && chunk[0] > 0) {
+			block = chunk[0];
+		}
+	}
+	if (block > dims[0]) {
+		block = dims[0];
+	}
 
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, "aircraft-display/1.0");
-	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+	g.band = malloc((size_t)g.xsize * g.ysize);
+	rows = malloc(block * dims[1] * sizeof(float));
+	if (!g.band || !rows) {
+		fprintf(stderr, "radar: %s: out of memory\n", path);
+		goto out;
+	}
 
-	res = curl_easy_perform(curl);
+	for (hsize_t row = 0; row < dims[0]; row += block) {
+		hsize_t start[2] = {row, 0};
+		hsize_t count[2] = {dims[0] - row < block ? dims[0] - row : block, dims[1]};
+		hid_t mspace = H5Screate_simple(2, count, NULL);
+		herr_t err = H5Sselect_hyperslab(space, H5S_SELECT_SET, start, NULL, count, NULL);
+		if (err >= 0) {
+			err = H5Dread(dset, H5T_NATIVE_FLOAT, mspace, space, H5P_DEFAULT, rows);
+		}
+		H5Sclose(mspace);
+		if (err < 0) {
+			fprintf(stderr, "radar: %s: read failed at row %llu\n", path, (unsigned long long)row);
+			goto out;
+		}
 
-	if(res != CURLE_OK) {
-		fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-		curl_easy_cleanup(curl);
-		curl_global_cleanup();
-		free(chunk.memory);
-		return -1;
+		uint8_t *out = g.band + row * dims[1];
+		for (size_t i = 0; i < count[0] * count[1]; i++) {
+			double raw = rows[i];
+			uint8_t b = WEATHER_NONE;
+			if (raw != nodata && raw != undetect) {
+				double value = offset + gain * raw;
+				while (b < WEATHER_EXTREME && value >= edge[b]) {
+					b++;
+				}
+			}
+			out[i] = b;
+		}
 	}
 
-	curl_easy_cleanup(curl);
-	curl_global_cleanup();
+	free(grid->band);
+	free(grid->pooled);
+	*grid = g;
+	g.band = NULL;
+	ret = 0;
 
-	json_error_t error;
-	json_t *root = json_loads(chunk.memory, 0, &error);
-	free(chunk.memory);
+out:
+	free(rows);
+	free(g.band);
+	if (dcpl >= 0) H5Pclose(dcpl);
+	if (space >= 0) H5Sclose(space);
+	if (dset >= 0) H5Dclose(dset);
+	H5Fclose(file);
+	return ret;
+}
+#else
+int radar_decode(const char *path, RadarGrid *grid) {
+	(void)grid;
+	fprintf(stderr, "radar: %s: built without HDF5 support\n", path);
+	return -1;
+}
+#endif
 
-	if(!root) {
-		fprintf(stderr, "JSON parsing error: %s\n", error.text);
+// Decode the newest .h5 file in dir unless it is the one already loaded;
+// returns 1 when grid changed, 0 when it is still current, -1 on error
+int radar_load_latest(const char *dir, RadarGrid *grid) {
+	DIR *d = opendir(dir);
+	if (!d) {
+		fprintf(stderr, "radar: cannot open %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	char best[PATH_MAX] = "";
+	time_t best_mtime = 0;
+	struct dirent *ent;
+	while ((ent = readdir(d)) != NULL) {
+		size_t len = strlen(ent->d_name);
+		if (len < 4 || (strcmp(ent->d_name + len - 3, ".h5") != 0 &&
+		                (len < 6 || strcmp(ent->d_name + len - 5, ".hdf5") != 0))) {
+			continue;
+		}
+		char path[PATH_MAX];
+		struct stat sb;
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		if (stat(path, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+			continue;
+		}
+		// Newest first; names break ties, they carry the product time
+		if (!best[0] || sb.st_mtime > best_mtime ||
+		    (sb.st_mtime == best_mtime && strcmp(path, best) > 0)) {
+			snprintf(best, sizeof(best), "%s", path);
+			best_mtime = sb.st_mtime;
+		}
+	}
+	closedir(d);
+
+	if (!best[0]) {
+		fprintf(stderr, "radar: no .h5 files in %s\n", dir);
+		return -1;
+	}
+	if (grid->band && strcmp(best, grid->path) == 0 && best_mtime == grid->mtime) {
+		return 0;
+	}
+	if (radar_decode(best, grid) < 0) {
+		return -1;
+	}
+	snprintf(grid->path, sizeof(grid->path), "%s", best);
+	grid->mtime = best_mtime;
+	if (grid->time == 0) {
+		grid->time = best_mtime;
+	}
+	return 1;
+}
+
+// Reprojection of a radar grid onto the weather layer, computed once per
+// view: for every cell the source pixels whose centers fall inside its
+// footprint (the nearest one when the cell is smaller than a pixel), stored
+// CSR-style. A composite is then remapped by a gather and a max per cell.
+// When a footprint spans several pixels the table addresses a max-pooled
+// level of the grid instead, so each cell still gathers only a few bytes.
+// Tables are cached on disk, keyed by everything they depend on.
+#define REMAP_MAGIC "ADSBREMP"
+#define REMAP_VERSION 3
+#define REMAP_CACHE_MAX 8     // tables kept in the cache directory
+#define REMAP_MAX_LEVEL 4     // pool by up to 16x16
+
+// View and grid geometry; compared bytewise, so always cleared before filling
+typedef struct {
+	int32_t width;
+	int32_t height;
+	int32_t xsize;          // of the grid at level 0
+	int32_t ysize;
+	int32_t level;          // max-pool level the table indexes
+	int32_t reserved;
+	double xscale;
+	double yscale;
+	double ul_e;
+	double ul_n;
+	double false_e;
+	double false_n;
+	double center_lat;
+	double center_lon;
+	double range_nm;
+} RemapKey;
+
+// Cache file: header, then start[] and index[] as raw arrays
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t entries;
+	RemapKey key;
+} RemapFileHeader;
+
+typedef struct {
+	RemapKey key;
+	int valid;
+	uint32_t *start;        // width * height + 1 offsets into index
+	uint32_t *index;        // pixel of the pooled grid, row * width + col
+	uint32_t entries;
+	void *base;             // cache file mapping holding the arrays, NULL when built
+	size_t size;
+	uint64_t built;
+	uint64_t loaded;
+} RemapTable;
+
+void remap_key(RemapKey *key, int width, int height, const RadarGrid *grid) {
+	memset(key, 0, sizeof(*key));
+	key->width = width;
+	key->height = height;
+	key->xsize = grid->xsize;
+	key->ysize = grid->ysize;
+	key->xscale = grid->xscale;
+	key->yscale = grid->yscale;
+	key->ul_e = grid->ul_e;
+	key->ul_n = grid->ul_n;
+	key->false_e = grid->false_e;
+	key->false_n = grid->false_n;
+	key->center_lat = view.lat;
+	key->center_lon = view.lon;
+	key->range_nm = view.range_nm;
+
+	// Pool until a pixel is about as large as a cell's footprint
+	double row_m = 1852.0 / screen_scale(width, height);
+	double footprint = sqrt(row_m / 2 / grid->xscale * row_m / grid->yscale);
+	while (key->level < REMAP_MAX_LEVEL && (2 << key->level) <= footprint) {
+		key->level++;
+	}
+}
+
+void free_remap(RemapTable *t) {
+	if (t->base) {
+		munmap(t->base, t->size);
+	} else {
+		free(t->start);
+		free(t->index);
+	}
+	t->base = NULL;
+	t->start = NULL;
+	t->index = NULL;
+	t->valid = 0;
+}
+
+// Compute the table for key: project the cell corners once, then take the
+// pixel-center range covered by each cell
+int remap_build(RemapTable *t, const RemapKey *key) {
+	int w = key->width, h = key->height;
+	int pool = 1 << key->level;
+	int xsize = (key->xsize + pool - 1) / pool;
+	int ysize = (key->ysize + pool - 1) / pool;
+	size_t corners = (size_t)(w + 1) * (h + 1);
+	size_t cells = (size_t)w * h;
+	double *gx = malloc(corners * sizeof(double));
+	double *gy = malloc(corners * sizeof(double));
+	uint32_t *start = malloc((cells + 1) * sizeof(uint32_t));
+	uint32_t *index = NULL;
+	if (!gx || !gy || !start) {
+		free(gx);
+		free(gy);
+		free(start);
+		return -1;
+	}
+
+	// Pooled grid coordinates in pixels, (0, 0) at the upper-left corner
+	for (int y = 0; y <= h; y++) {
+		for (int x = 0; x <= w; x++) {
+			double lat, lon, e, n;
+			screen_point_to_latlon(x - 0.5, y - 0.5, w, h, &lat, &lon);
+			swiss_project(lat, lon, key->false_e, key->false_n, &e, &n);
+			gx[y * (w + 1) + x] = (e - key->ul_e) / (key->xscale * pool);
+			gy[y * (w + 1) + x] = (key->ul_n - n) / (key->yscale * pool);
+		}
+	}
+
+	// Count, then fill
+	for (int pass = 0; pass < 2; pass++) {
+		uint32_t count = 0;
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				size_t c = (size_t)y * (w + 1) + x;
+				size_t quad[4] = {c, c + 1, c + w + 1, c + w + 2};
+				double x0 = gx[c], x1 = gx[c], y0 = gy[c], y1 = gy[c];
+				for (int i = 1; i < 4; i++) {
+					x0 = fmin(x0, gx[quad[i]]);
+					x1 = fmax(x1, gx[quad[i]]);
+					y0 = fmin(y0, gy[quad[i]]);
+					y1 = fmax(y1, gy[quad[i]]);
+				}
+
+				int col0 = (int)ceil(x0 - 0.5), col1 = (int)floor(x1 - 0.5);
+				int row0 = (int)ceil(y0 - 0.5), row1 = (int)floor(y1 - 0.5);
+				if (col0 > col1) {
+					col0 = col1 = (int)floor((x0 + x1) / 2);
+				}
+				if (row0 > row1) {
+					row0 = row1 = (int)floor((y0 + y1) / 2);
+				}
+				if (col0 < 0) col0 = 0;
+				if (row0 < 0) row0 = 0;
+				if (col1 >= xsize) col1 = xsize - 1;
+				if (row1 >= ysize) row1 = ysize - 1;
+
+				if (pass == 0) {
+					start[(size_t)y * w + x] = count;
+				}
+				for (int row = row0; row <= row1; row++) {
+					for (int col = col0; col <= col1; col++) {
+						if (pass == 1) {
+							index[count] = (uint32_t)row * xsize + col;
+						}
+						count++;
+					}
+				}
+			}
+		}
+		if (pass == 0) {
+			start[cells] = count;
+			index = malloc((count ? count : 1) * sizeof(uint32_t));
+			if (!index) {
+				free(gx);
+				free(gy);
+				free(start);
+				return -1;
+			}
+		}
+	}
+	free(gx);
+	free(gy);
+
+	free_remap(t);
+	t->key = *key;
+	t->start = start;
+	t->index = index;
+	t->entries = start[cells];
+	t->valid = 1;
+	t->built++;
+	return 0;
+}
+
+// Cache directory: $HOME/.cache/aircraft_display_radar, NULL without a home
+const char *default_cache_dir(void) {
+	static char path[PATH_MAX];
+	const char *home = getenv("HOME");
+	if (!home || !home[0]) {
+		return NULL;
+	}
+	snprintf(path, sizeof(path), "%s/.cache", home);
+	mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/.cache/aircraft_display_radar", home);
+	mkdir(path, 0755);
+	return path;
+}
+
+static void remap_cache_path(char *path, size_t len, const char *dir, const RemapKey *key) {
+	// FNV-1a over the key bytes
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const uint8_t *bytes = (const uint8_t *)key;
+	for (size_t i = 0; i < sizeof(*key); i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	}
+	snprintf(path, len, "%s/remap-%016llx.bin", dir, (unsigned long long)hash);
+}
+
+// Map a cached table; the arrays stay in the mapping
+int remap_load(RemapTable *t, const RemapKey *key, const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(RemapFileHeader)) {
+		close(fd);
+		return -1;
+	}
+	void *base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+	const RemapFileHeader *header = (const RemapFileHeader *)base;
+	size_t cells = (size_t)key->width * key->height;
+	size_t expected = sizeof(*header) + (cells + 1 + header->entries) * sizeof(uint32_t);
+	const uint32_t *start = (const uint32_t *)((const uint8_t *)base + sizeof(*header));
+	if (memcmp(header->magic, REMAP_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != REMAP_VERSION || memcmp(&header->key, key, sizeof(*key)) != 0 ||
+	    expected != (size_t)sb.st_size || start[cells] != header->entries) {
+		munmap(base, sb.st_size);
+		return -1;
+	}
+
+	free_remap(t);
+	t->key = *key;
+	t->base = base;
+	t->size = sb.st_size;
+	t->start = (uint32_t *)start;
+	t->index = (uint32_t *)(start + cells + 1);
+	t->entries = header->entries;
+	t->valid = 1;
+	t->loaded++;
+	utimensat(AT_FDCWD, path, NULL, 0);  // the mtime orders the cache for pruning
+	return 0;
+}
+
+// Drop the least recently used tables beyond REMAP_CACHE_MAX
+static void remap_cache_prune(const char *dir) {
+	for (;;) {
+		DIR *d = opendir(dir);
+		if (!d) {
+			return;
+		}
+		char oldest[PATH_MAX] = "";
+		time_t oldest_mtime = 0;
+		int count = 0;
+		struct dirent *ent;
+		while ((ent = readdir(d)) != NULL) {
+			if (strncmp(ent->d_name, "remap-", 6) != 0) {
+				continue;
+			}
+			char path[PATH_MAX];
+			struct stat sb;
+			snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+			if (stat(path, &sb) < 0) {
+				continue;
+			}
+			count++;
+			if (!oldest[0] || sb.st_mtime < oldest_mtime) {
+				snprintf(oldest, sizeof(oldest), "%s", path);
+				oldest_mtime = sb.st_mtime;
+			}
+		}
+		closedir(d);
+		if (count <= REMAP_CACHE_MAX || unlink(oldest) < 0) {
+			return;
+		}
+	}
+}
+
+// Write the table through a temporary file, like the snapshot
+int remap_save(const RemapTable *t, const char *path, const char *dir) {
+	char tmp[PATH_MAX + 8];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+
+	RemapFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, REMAP_MAGIC, sizeof(header.magic));
+	header.version = REMAP_VERSION;
+	header.entries = t->entries;
+	header.key = t->key;
+
+	size_t cells = (size_t)t->key.width * t->key.height;
+	struct iovec iov[3] = {
+		{&header, sizeof(header)},
+		{t->start, (cells + 1) * sizeof(uint32_t)},
+		{t->index, t->entries * sizeof(uint32_t)},
+	};
+	size_t total = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+	ssize_t written = writev(fd, iov, 3);
+	close(fd);
+
+	if (written != (ssize_t)total || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return -1;
+	}
+	remap_cache_prune(dir);
+	return 0;
+}
+
+// Make t match key: keep it, load it from the cache, or build and cache it
+int remap_prepare(RemapTable *t, const RemapKey *key, const char *cache_dir) {
+	if (t->valid && memcmp(&t->key, key, sizeof(*key)) == 0) {
+		return 0;
+	}
+	char path[PATH_MAX];
+	if (cache_dir) {
+		remap_cache_path(path, sizeof(path), cache_dir, key);
+		if (remap_load(t, key, path) == 0) {
+			return 0;
+		}
+	}
+	if (remap_build(t, key) < 0) {
+		return -1;
+	}
+	if (cache_dir) {
+		remap_save(t, path, cache_dir);
+	}
+	return 0;
+}
+
+// Remap a composite, pooled to the table's level, into the weather layer:
+// gather and max per cell
+void remap_apply(WeatherIntensity *layer, const RemapTable *t, const uint8_t *band) {
+	size_t cells = (size_t)t->key.width * t->key.height;
+	const uint32_t *start = t->start;
+	const uint32_t *index = t->index;
+
+	for (size_t c = 0; c < cells; c++) {
+		uint8_t max = WEATHER_NONE;
+		for (uint32_t k = start[c]; k < start[c + 1]; k++) {
+			uint8_t b = band[index[k]];
+			max = b > max ? b : max;
+		}
+		layer[c] = (WeatherIntensity)max;
+	}
+}
+
+// Nowcast between refreshes: block matching between the last two layers
+// gives a coarse motion field, and the newest layer is advected along it
+// once per sweep revolution until the next refresh replaces it. Blocks are
+// compared on a fixed lattice of samples, so the cost does not grow with
+// the screen, and a block whose best match is poor is taken as standing
+// still rather than moved by noise.
+#define NOWCAST_BLOCKS_X 16
+#define NOWCAST_BLOCKS_Y 12
+#define NOWCAST_SAMPLES 8          // compared per block and axis
+#define NOWCAST_MAX_SPEED_KT 80.0  // fastest echo motion searched for
+#define NOWCAST_MAX_SEARCH 8       // search radius cap in rows
+#define NOWCAST_MAX_ERROR 0.5      // mean band difference of an accepted match
+#define NOWCAST_MAX_LEAD_S 600.0   // furthest a layer is extrapolated
+
+typedef struct {
+	int width;
+	int height;
+	WeatherIntensity *prev;    // the two newest source layers
+	WeatherIntensity *cur;
+	time_t prev_time;          // their product times
+	time_t cur_time;
+	time_t cur_taken;          // when the newest arrived, the nowcast runs from here
+	int frames;                // layers held, up to 2
+	float vx[NOWCAST_BLOCKS_Y][NOWCAST_BLOCKS_X];  // columns per second
+	float vy[NOWCAST_BLOCKS_Y][NOWCAST_BLOCKS_X];  // rows per second
+	int moving;                // blocks with a motion vector
+} Nowcast;
+
+void free_nowcast(Nowcast *nc) {
+	free(nc->prev);
+	free(nc->cur);
+	memset(nc, 0, sizeof(*nc));
+}
+
+// Motion of each block from prev to cur: the displacement whose shifted
+// prev block differs least from the cur block, on a sample lattice
+static void nowcast_estimate(Nowcast *nc) {
+	int w = nc->width, h = nc->height;
+	double dt = difftime(nc->cur_time, nc->prev_time);
+	memset(nc->vx, 0, sizeof(nc->vx));
+	memset(nc->vy, 0, sizeof(nc->vy));
+	nc->moving = 0;
+	if (dt <= 0 || w < NOWCAST_BLOCKS_X || h < NOWCAST_BLOCKS_Y) {
+		return;
+	}
+
+	// Rows are half as wide as they are tall, so columns search twice as far
+	int ry = (int)ceil(NOWCAST_MAX_SPEED_KT * dt / 3600.0 * screen_scale(w, h));
+	if (ry > NOWCAST_MAX_SEARCH) ry = NOWCAST_MAX_SEARCH;
+	if (ry < 1) ry = 1;
+	int rx = 2 * ry;
+
+	int bw = w / NOWCAST_BLOCKS_X, bh = h / NOWCAST_BLOCKS_Y;
+	int sx = bw > NOWCAST_SAMPLES ? bw / NOWCAST_SAMPLES : 1;
+	int sy = bh > NOWCAST_SAMPLES ? bh / NOWCAST_SAMPLES : 1;
+	for (int by = 0; by < NOWCAST_BLOCKS_Y; by++) {
+		for (int bx = 0; bx < NOWCAST_BLOCKS_X; bx++) {
+			int x0 = bx * bw, y0 = by * bh;
+			int samples = 0, wet = 0;
+			for (int y = y0; y < y0 + bh; y += sy) {
+				for (int x = x0; x < x0 + bw; x += sx) {
+					wet += nc->cur[(size_t)y * w + x] != WEATHER_NONE;
+					samples++;
+				}
+			}
+			if (wet == 0) {
+				continue;
+			}
+
+			// Ties go to the smaller displacement, so still echoes stay still
+			int best = INT_MAX, best_dx = 0, best_dy = 0, best_len = 0;
+			for (int dy = -ry; dy <= ry; dy++) {
+				for (int dx = -rx; dx <= rx; dx++) {
+					int err = 0;
+					for (int y = y0; y < y0 + bh && err <= best; y += sy) {
+						int py = y - dy;
+						const WeatherIntensity *row = py >= 0 && py < h ? nc->prev + (size_t)py * w : NULL;
+						for (int x = x0; x < x0 + bw; x += sx) {
+							int px = x - dx;
+							int p = row && px >= 0 && px < w ? row[px] : WEATHER_NONE;
+							err += abs((int)nc->cur[(size_t)y * w + x] - p);
+						}
+					}
+					int len = abs(dx) + 2 * abs(dy);
+					if (err < best || (err == best && len < best_len)) {
+						best = err;
+						best_dx = dx;
+						best_dy = dy;
+						best_len = len;
+					}
+				}
+			}
+			if (best <= NOWCAST_MAX_ERROR * samples && best_len > 0) {
+				nc->vx[by][bx] = (float)(best_dx / dt);
+				nc->vy[by][bx] = (float)(best_dy / dt);
+				nc->moving++;
+			}
+		}
+	}
+}
+
+// Take a refreshed layer as the newest frame and re-estimate the motion;
+// a layer of another size starts the history again
+int nowcast_push(Nowcast *nc, const WeatherIntensity *layer, int width, int height, time_t t) {
+	size_t cells = (size_t)width * height;
+	if (width != nc->width || height != nc->height) {
+		free_nowcast(nc);
+		nc->prev = malloc(cells * sizeof(WeatherIntensity));
+		nc->cur = malloc(cells * sizeof(WeatherIntensity));
+		if (!nc->prev || !nc->cur) {
+			free_nowcast(nc);
+			return -1;
+		}
+		nc->width = width;
+		nc->height = height;
+	}
+	// The same product again (an unchanged composite redrawn) is no new frame
+	if (nc->frames > 0 && t == nc->cur_time) {
+		memcpy(nc->cur, layer, cells * sizeof(WeatherIntensity));
+		return 0;
+	}
+
+	WeatherIntensity *old = nc->prev;
+	nc->prev = nc->cur;
+	nc->prev_time = nc->cur_time;
+	nc->cur = old;
+	nc->cur_time = t;
+	nc->cur_taken = time(NULL);
+	memcpy(nc->cur, layer, cells * sizeof(WeatherIntensity));
+	if (nc->frames < 2) {
+		nc->frames++;
+	}
+	if (nc->frames == 2) {
+		nowcast_estimate(nc);
+	} else {
+		nc->moving = 0;
+	}
+	return 0;
+}
+
+// The newest layer moved on by lead seconds: each cell takes the value found
+// upstream along the motion field, interpolated between block centers
+void nowcast_advect(const Nowcast *nc, WeatherIntensity *out, double lead) {
+	int w = nc->width, h = nc->height;
+	double bw = (double)(w / NOWCAST_BLOCKS_X), bh = (double)(h / NOWCAST_BLOCKS_Y);
+	if (lead > NOWCAST_MAX_LEAD_S) {
+		lead = NOWCAST_MAX_LEAD_S;
+	}
+
+	for (int y = 0; y < h; y++) {
+		double fy = (y + 0.5) / bh - 0.5;
+		if (fy < 0) fy = 0;
+		if (fy > NOWCAST_BLOCKS_Y - 1) fy = NOWCAST_BLOCKS_Y - 1;
+		int by = (int)fy;
+		int by1 = by + 1 < NOWCAST_BLOCKS_Y ? by + 1 : by;
+		float ty = (float)(fy - by);
+		WeatherIntensity *row = out + (size_t)y * w;
+		for (int x = 0; x < w; x++) {
+			double fx = (x + 0.5) / bw - 0.5;
+			if (fx < 0) fx = 0;
+			if (fx > NOWCAST_BLOCKS_X - 1) fx = NOWCAST_BLOCKS_X - 1;
+			int bx = (int)fx;
+			int bx1 = bx + 1 < NOWCAST_BLOCKS_X ? bx + 1 : bx;
+			float tx = (float)(fx - bx);
+
+			float vx = (1 - ty) * ((1 - tx) * nc->vx[by][bx] + tx * nc->vx[by][bx1]) +
+			           ty * ((1 - tx) * nc->vx[by1][bx] + tx * nc->vx[by1][bx1]);
+			float vy = (1 - ty) * ((1 - tx) * nc->vy[by][bx] + tx * nc->vy[by][bx1]) +
+			           ty * ((1 - tx) * nc->vy[by1][bx] + tx * nc->vy[by1][bx1]);
+			int sx = (int)lround(x - vx * lead);
+			int sy = (int)lround(y - vy * lead);
+			row[x] = sx >= 0 && sx < w && sy >= 0 && sy < h ? nc->cur[(size_t)sy * w + sx] : WEATHER_NONE;
+		}
+	}
+}
+
+// Weather is produced off the event loop: the worker fetches and rasterizes
+// into a buffer of its own, publishes it by swapping pointers under the lock
+// and wakes the loop through an eventfd. The loop then swaps the finished
+// layer into temp_screen and the sweep reveals it, so a refresh costs the
+// loop a few pointer writes however long the fetch takes. Between refreshes
+// the loop asks once per revolution for the nowcast, published the same way.
+typedef struct {
+	pthread_t thread;
+	int started;
+	int event_fd;           // readable when a layer has been published
+
+	// Shared with the worker thread
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int want_width;         // requested layer size, 0 when there is no request
+	int want_height;
+	int want_fetch;         // refresh the source first, not just redraw it
+	int want_advect;        // move the newest layer on along its motion
+	int stop;
+	WeatherIntensity *ready;     // published layer, NULL once taken
+	int ready_width;
+	int ready_height;
+	WeatherField ready_field;
+	WeatherIntensity *spare;     // layer handed back by the loop for reuse
+	size_t spare_cells;
+
+	// Worker thread only
+	WeatherIntensity *back;
+	size_t back_cells;
+	const char *radar_dir;  // ODIM-HDF5 composites, NULL for the simulated field
+	const char *cache_dir;  // reprojection tables, NULL to always build them
+	RadarGrid grid;
+	RemapTable remap;
+	int published_width;    // size of the last layer published
+	int published_height;
+	WeatherField field;
+	time_t field_time;      // when the simulated field was fetched
+	int nowcast_enabled;
+	Nowcast nowcast;
+	uint64_t layers;
+} WeatherWorker;
+
+static void *weather_worker_main(void *arg) {
+	WeatherWorker *ww = (WeatherWorker *)arg;
+
+	pthread_mutex_lock(&ww->lock);
+	for (;;) {
+		while (!ww->stop && ww->want_width == 0 && !ww->want_advect) {
+			pthread_cond_wait(&ww->wake, &ww->lock);
+		}
+		if (ww->stop) {
+			break;
+		}
+		// A fresh layer supersedes moving the old one on
+		int width = ww->want_width;
+		int height = ww->want_height;
+		int fetch = ww->want_fetch;
+		int advect = width == 0;
+		ww->want_width = ww->want_height = ww->want_fetch = ww->want_advect = 0;
+		if (!ww->back && ww->spare) {
+			ww->back = ww->spare;
+			ww->back_cells = ww->spare_cells;
+			ww->spare = NULL;
+		}
+		pthread_mutex_unlock(&ww->lock);
+
+		// Nothing to advect while no motion has been seen
+		Nowcast *nc = &ww->nowcast;
+		if (advect) {
+			if (nc->moving == 0) {
+				pthread_mutex_lock(&ww->lock);
+				continue;
+			}
+			width = nc->width;
+			height = nc->height;
+		}
+
+		size_t cells = (size_t)width * height;
+		if (ww->back_cells < cells) {
+			free(ww->back);
+			ww->back = malloc(cells * sizeof(WeatherIntensity));
+			ww->back_cells = ww->back ? cells : 0;
+		}
+		// An unchanged composite is not drawn again unless the size changed
+		int ok = ww->back != NULL;
+		if (ok && advect) {
+			double lead = difftime(time(NULL), nc->cur_taken);
+			nowcast_advect(nc, ww->back, lead > 0 ? lead : 0);
+		} else {
+			if (ok && fetch && ww->radar_dir) {
+				int changed = radar_load_latest(ww->radar_dir, &ww->grid);
+				ok = changed > 0 || (changed == 0 && (width != ww->published_width ||
+				                                      height != ww->published_height));
+			} else if (ok && fetch) {
+				ok = fetch_weather_data(&ww->field) == 0;
+				if (ok) {
+					ww->field_time = time(NULL);
+				}
+			}
+			if (ok && ww->radar_dir) {
+				RemapKey key;
+				remap_key(&key, width, height, &ww->grid);
+				const uint8_t *band = ww->grid.band ? radar_pool(&ww->grid, key.level) : NULL;
+				ok = band && remap_prepare(&ww->remap, &key, ww->cache_dir) == 0;
+				if (ok) {
+					remap_apply(ww->back, &ww->remap, band);
+				}
+			} else if (ok) {
+				rasterize_weather(ww->back, width, height, &ww->field);
+			}
+			if (ok && ww->nowcast_enabled) {
+				nowcast_push(nc, ww->back, width, height,
+				             ww->radar_dir ? ww->grid.time : ww->field_time);
+			}
+		}
+
+		pthread_mutex_lock(&ww->lock);
+		if (ok) {
+			// A layer the loop never took becomes the next back buffer
+			WeatherIntensity *old = ww->ready;
+			size_t old_cells = (size_t)ww->ready_width * ww->ready_height;
+			ww->ready = ww->back;
+			ww->ready_width = width;
+			ww->ready_height = height;
+			ww->ready_field = ww->field;
+			ww->published_width = width;
+			ww->published_height = height;
+			ww->back = old;
+			ww->back_cells = old ? old_cells : 0;
+			ww->layers++;
+
+			uint64_t one = 1;
+			if (write(ww->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+				perror("weather: eventfd");
+			}
+		}
+	}
+	pthread_mutex_unlock(&ww->lock);
+	return NULL;
+}
+
+int weather_start(WeatherWorker *ww, const char *radar_dir, int nowcast) {
+	memset(ww, 0, sizeof(*ww));
+	ww->radar_dir = radar_dir;
+	ww->nowcast_enabled = nowcast;
+	ww->cache_dir = radar_dir ? default_cache_dir() : NULL;
+	ww->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ww->event_fd < 0) {
+		perror("weather: eventfd");
+		return -1;
+	}
+
+	pthread_mutex_init(&ww->lock, NULL);
+	pthread_cond_init(&ww->wake, NULL);
+	if (pthread_create(&ww->thread, NULL, weather_worker_main, ww) != 0) {
+		fprintf(stderr, "weather: cannot start worker thread\n");
+		return -1;
+	}
+	ww->started = 1;
+	return 0;
+}
+
+// Ask for a layer of the given size, from refreshed source data when fetch
+// is set; a pending request is replaced
+void weather_request(WeatherWorker *ww, int width, int height, int fetch) {
+	pthread_mutex_lock(&ww->lock);
+	ww->want_width = width;
+	ww->want_height = height;
+	ww->want_fetch |= fetch;
+	pthread_cond_signal(&ww->wake);
+	pthread_mutex_unlock(&ww->lock);
+}
+
+// Ask for the newest layer advected to the present; ignored while a layer
+// is being made anyway
+void weather_advect(WeatherWorker *ww) {
+	pthread_mutex_lock(&ww->lock);
+	if (ww->want_width == 0) {
+		ww->want_advect = 1;
+		pthread_cond_signal(&ww->wake);
+	}
+	pthread_mutex_unlock(&ww->lock);
+}
+
+// Swap the published layer into the matrix when it was made for its size;
+// returns 1 with the field it was drawn from, 0 when there was none to take
+int weather_take(WeatherWorker *ww, Matrix *matrix, WeatherField *field) {
+	uint64_t count;
+	if (read(ww->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+		perror("weather: eventfd");
+	}
+
+	int taken = 0;
+	pthread_mutex_lock(&ww->lock);
+	if (ww->ready) {
+		WeatherIntensity *old = ww->ready;
+		size_t old_cells = (size_t)ww->ready_width * ww->ready_height;
+		if (ww->ready_width == matrix->width && ww->ready_height == matrix->height) {
+			old = matrix_swap_weather(matrix, ww->ready);
+			*field = ww->ready_field;
+			taken = 1;
+		} else if (ww->want_width == 0) {
+			// Made for the size before a resize
+			ww->want_width = matrix->width;
+			ww->want_height = matrix->height;
+			pthread_cond_signal(&ww->wake);
+		}
+		ww->ready = NULL;
+		free(ww->spare);
+		ww->spare = old;
+		ww->spare_cells = old_cells;
+	}
+	pthread_mutex_unlock(&ww->lock);
+	return taken;
+}
+
+void weather_stop(WeatherWorker *ww) {
+	if (!ww->started) {
+		return;
+	}
+	pthread_mutex_lock(&ww->lock);
+	ww->stop = 1;
+	pthread_cond_signal(&ww->wake);
+	pthread_mutex_unlock(&ww->lock);
+	pthread_join(ww->thread, NULL);
+
+	pthread_mutex_destroy(&ww->lock);
+	pthread_cond_destroy(&ww->wake);
+	free(ww->ready);
+	free(ww->spare);
+	free(ww->back);
+	free_radar_grid(&ww->grid);
+	free_remap(&ww->remap);
+	free_nowcast(&ww->nowcast);
+	close(ww->event_fd);
+	ww->started = 0;
+}
+
+// Display "X" at given coordinates
+void display_symbol(Matrix *matrix, int x, int y) {
+	int scaled_x = x * 2;
+
+	if (scaled_x >= 0 && scaled_x < matrix->width && y >= 0 && y < matrix->height) {
+		matrix->data[y][scaled_x] = 'X';
+	}
+}
+
+void clear_matrix(Matrix *matrix) {
+	for (int i = 0; i < matrix->height; i++) {
+		for (int j = 0; j < matrix->width; j++) {
+			matrix->data[i][j] = ' ';
+			matrix->weather[i][j] = WEATHER_NONE;
+		}
+	}
+}
+
+// Convert lat/lon to screen coordinates (x in symbol columns, half the
+// character width); returns 0 when the position falls off the screen or on
+// the title row, so callers drop the target instead of piling it on an edge
+int latlon_to_screen(double lat, double lon, int *screen_x, int *screen_y, int width, int height) {
+	double x_nm, y_nm;
+	project(lat, lon, &x_nm, &y_nm);
+	double scale = screen_scale(width, height);
+
+	*screen_x = (width / 4) + (int)(x_nm * scale);
+	*screen_y = (height / 2) - (int)(y_nm * scale);
+
+	return *screen_x >= 0 && *screen_x < width / 2 && *screen_y >= 1 && *screen_y < height;
+}
+
+// Build the OpenSky states URL for the bounding box around the view range
+void build_aircraft_url(char *url, size_t len) {
+	// Widest longitude on the range circle, not at the center's own latitude
+	double c = view.range_nm / EARTH_RADIUS_NM;
+	double lat_range = c * 180.0 / M_PI;
+	double lon_range = 180.0;
+	if (sin(c) < view.cos_lat) {
+		lon_range = asin(sin(c) / view.cos_lat) * 180.0 / M_PI;
+	}
+	double lamin = fmax(view.lat - lat_range, -90.0), lamax = fmin(view.lat + lat_range, 90.0);
+
+	snprintf(url, len,
+	         "https://opensky-network.org/api/states/all?lamin=%.4f&lomin=%.4f&lamax=%.4f&lomax=%.4f",
+	         lamin, view.lon - lon_range, lamax, view.lon + lon_range);
+}
+
+// Parse an OpenSky states response; the JSON DOM and the aircraft list are
+// allocated from the arena, so the list lives until that arena is reset
+int parse_aircraft_data(Arena *arena, const char *json_text, size_t length,
+                        Aircraft **aircraft_list, int *count) {
+	json_error_t error;
+
+	json_arena = arena;
+	json_set_alloc_funcs(json_arena_malloc, json_arena_free);
+	json_t *root = json_loadb(json_text, length, 0, &error);
+
+	if(!root) {
+		json_set_alloc_funcs(malloc, free);
+		fprintf(stderr, "JSON parsing error: %s\n", error.text);
 		return -1;
 	}
 
@@ -470,12 +1949,22 @@ int fetch_aircraft_data(Aircraft **aircraft_list, int *count) {
 	if(!json_is_array(states)) {
 		fprintf(stderr, "No states array in response\n");
 		json_decref(root);
+		json_set_alloc_funcs(malloc, free);
 		return -1;
 	}
 
+	json_t *time_json = json_object_get(root, "time");
+	int64_t response_time = json_is_integer(time_json) ? json_integer_value(time_json) : (int64_t)time(NULL);
+
 	size_t array_size = json_array_size(states);
-	*aircraft_list = malloc(array_size * sizeof(Aircraft));
+	*aircraft_list = arena_alloc(arena, array_size * sizeof(Aircraft));
 	*count = 0;
+	if (!*aircraft_list) {
+		fprintf(stderr, "Not enough memory for %zu aircraft\n", array_size);
+		json_decref(root);
+		json_set_alloc_funcs(malloc, free);
+		return -1;
+	}
 
 	for(size_t i = 0; i < array_size; i++) {
 		json_t *state = json_array_get(states, i);
@@ -485,6 +1974,9 @@ int fetch_aircraft_data(Aircraft **aircraft_list, int *count) {
 		json_t *lat_json = json_array_get(state, 6);
 		json_t *altitude_json = json_array_get(state, 7);
 		json_t *velocity_json = json_array_get(state, 9);
+		json_t *icao_json = json_array_get(state, 0);
+		json_t *time_position_json = json_array_get(state, 3);
+		json_t *track_json = json_array_get(state, 10);
 
 		if(!json_is_string(callsign_json) || !json_is_number(lat_json) || 
 		   !json_is_number(lon_json) || !json_is_number(altitude_json)) {
@@ -506,146 +1998,5738 @@ int fetch_aircraft_data(Aircraft **aircraft_list, int *count) {
 		ac->longitude = json_number_value(lon_json);
 		ac->altitude = json_number_value(altitude_json);
 		ac->velocity = json_is_number(velocity_json) ? json_number_value(velocity_json) : 0.0;
+		ac->track = json_is_number(track_json) ? json_number_value(track_json) : -1.0;
+		ac->icao24 = json_is_string(icao_json) ? (uint32_t)strtoul(json_string_value(icao_json), NULL, 16) : 0;
+		ac->timestamp = json_is_integer(time_position_json) ? json_integer_value(time_position_json) : response_time;
 		ac->squawk = 0;
 
-		ac->distance = calculate_distance(LSZH_LAT, LSZH_LON, ac->latitude, ac->longitude);
+		ac->distance = calculate_distance(view.lat, view.lon, ac->latitude, ac->longitude);
 
-		if(ac->distance <= RANGE_NM) {
+		if(ac->distance <= view.range_nm) {
 			(*count)++;
 		}
 	}
 
 	json_decref(root);
+	json_set_alloc_funcs(malloc, free);
 	return 0;
 }
 
-int main() {
-	printf("ADS-B Aircraft Display with MeteoSwiss Weather Radar - LSZH (Zurich Airport)\n");
-	printf("Range: %.0f nautical miles\n", RANGE_NM);
-	printf("Weather data: Simulated radar (Source: MeteoSwiss)\n");
-	printf("================================================================================\n\n");
-	printf("Connecting to OpenSky Network API...\n\n");
+// Filter shared by symbols and trails: ground traffic and slow movers are hidden
+int aircraft_visible(const Aircraft *ac) {
+	int altitude_ft = (int)(ac->altitude * 3.28084);
+	int speed_kts = (int)(ac->velocity * 1.94384);
+	return altitude_ft > 1800 && speed_kts > 60;
+}
 
-	Matrix *screen = create_square_matrix(120);
-	Matrix *temp_screen = create_square_matrix(120);
-	
-	clear_matrix(screen);
-	clear_matrix(temp_screen);
-	
-	int center_x = screen->width / 2;
-	int center_y = screen->height / 2;
-	int max_radius = (int)sqrt(center_x * center_x + center_y * center_y) + 1;
-	int num_angles = 720;
-	int current_angle = 0;
-	
-	time_t last_fetch_time = 0;
-	time_t last_weather_fetch = 0;
-	int fetch_interval = 10;
-	int weather_fetch_interval = 60;  // Update weather every 60 seconds
+// Label placement: symbols, the title and the center marker are reserved in a
+// bit-packed occupancy grid first, then labels are placed nearest aircraft
+// first. Each label tries the positions around its symbol, then the same
+// corners pushed out on longer leader lines, then a callsign-only label; an
+// aircraft whose label fits nowhere keeps just its symbol.
+#define LABEL_LINES 4
+#define LABEL_MAX_WIDTH 16
+#define LABEL_MAX_LEADER 3      // longest leader line, in rows
 
-	while(1) {
-		time_t current_time = time(NULL);
-		
-		// Fetch weather data periodically
-		if (current_time - last_weather_fetch >= weather_fetch_interval) {
-			fetch_weather_data(temp_screen);
-			last_weather_fetch = current_time;
-		}
-		
-		// Check if it's time to fetch new aircraft data
-		if (current_time - last_fetch_time >= fetch_interval) {
-			Aircraft *aircraft_list = NULL;
-			int aircraft_count = 0;
-
-			if(fetch_aircraft_data(&aircraft_list, &aircraft_count) == 0) {
-				// Clear only the aircraft data, keep weather
-				for (int i = 0; i < temp_screen->height; i++) {
-					for (int j = 0; j < temp_screen->width; j++) {
-						temp_screen->data[i][j] = ' ';
-					}
-				}
+typedef struct {
+	char lines[LABEL_LINES][LABEL_MAX_WIDTH];
+	int len[LABEL_LINES];
+	int width;
+} Label;
 
-				// Display title at top
-				char title[100];
-				snprintf(title, sizeof(title), "LSZH - Aircraft: %d | Weather: MeteoSwiss Radar (Simulated)", aircraft_count);
-				for(int i = 0; title[i] != '\0' && i < temp_screen->width; i++) {
-					temp_screen->data[0][i] = title[i];
-				}
+// Cells one aircraft occupies in the layout: symbol, leader line and label
+typedef struct {
+	int16_t x;                  // symbol cell
+	int16_t y;
+	int16_t top;                // label rect; lines = 0 without a label
+	int16_t left;
+	uint8_t lines;
+	uint8_t width;
+	int8_t dx;                  // leader direction and length in cells
+	int8_t dy;
+	uint8_t leader;
+} Footprint;
 
-				// Draw center marker for LSZH
-				int center_x_marker = temp_screen->width / 4;
-				int center_y_marker = temp_screen->height / 2;
-				if(center_y_marker >= 0 && center_y_marker < temp_screen->height && center_x_marker * 2 < temp_screen->width) {
-					temp_screen->data[center_y_marker][center_x_marker * 2] = '+';
-				}
+typedef struct {
+	int index;                  // into the aircraft list
+	double distance;
+	Footprint fp;
+} LabelTarget;
 
-				// Display each aircraft
-				for(int i = 0; i < aircraft_count; i++) {
-					Aircraft *ac = &aircraft_list[i];
+typedef struct {
+	uint64_t *bits;             // one bit per cell, rows of `words` words
+	int words;
+	int height;
+	int width;
+	size_t bits_cap;
+	LabelTarget *targets;       // one per drawn symbol, with its footprint
+	int target_count;
+	int targets_cap;
+	int placed;                 // labels next to their symbol
+	int leadered;               // labels moved out on a longer leader line
+	int reduced;                // callsign only
+	int dropped;                // no room at all
+} LabelPlacer;
 
-					int screen_x, screen_y;
-					latlon_to_screen(ac->latitude, ac->longitude, &screen_x, &screen_y, 
-					                temp_screen->width, temp_screen->height);
+static LabelPlacer label_placer;
 
-					int altitude_ft = (int)(ac->altitude * 3.28084);
-					int speed_kts = (int)(ac->velocity * 1.94384);
+// Reset the grid for a matrix of this size
+static int label_placer_begin(LabelPlacer *lp, int height, int width, int targets) {
+	int words = (width + 63) / 64;
+	size_t need = (size_t)words * height;
+	if (need > lp->bits_cap) {
+		uint64_t *bits = realloc(lp->bits, need * sizeof(uint64_t));
+		if (!bits) return -1;
+		lp->bits = bits;
+		lp->bits_cap = need;
+	}
+	if (targets > lp->targets_cap) {
+		LabelTarget *ptr = realloc(lp->targets, targets * sizeof(LabelTarget));
+		if (!ptr) return -1;
+		lp->targets = ptr;
+		lp->targets_cap = targets;
+	}
+	memset(lp->bits, 0, need * sizeof(uint64_t));
+	lp->words = words;
+	lp->height = height;
+	lp->width = width;
+	lp->target_count = 0;
+	lp->placed = lp->leadered = lp->reduced = lp->dropped = 0;
+	return 0;
+}
 
-					if(altitude_ft <= 1800 || speed_kts <= 60) {
-						continue;
-					}
+// Mask of bits c0..c1 (inclusive) within word w of a row
+static inline uint64_t span_mask(int w, int c0, int c1) {
+	int lo = c0 > w * 64 ? c0 - w * 64 : 0;
+	int hi = c1 < w * 64 + 63 ? c1 - w * 64 : 63;
+	uint64_t upper = hi == 63 ? ~0ull : (1ull << (hi + 1)) - 1;
+	return upper & ~((1ull << lo) - 1);
+}
+
+// Is every cell of rows r0..r1, columns c0..c1 free (and on the matrix)?
+static int label_rect_free(const LabelPlacer *lp, int r0, int r1, int c0, int c1) {
+	if (r0 < 1 || r1 >= lp->height || c0 < 0 || c1 >= lp->width) {
+		return 0;
+	}
+	// Labels are narrower than a word, so a rect spans at most two words per row
+	int w0 = c0 / 64, w1 = c1 / 64;
+	uint64_t m0 = span_mask(w0, c0, c1);
+	uint64_t m1 = w1 > w0 ? span_mask(w1, c0, c1) : 0;
+	if (w1 > w0 + 1) {
+		return 0;
+	}
+	const uint64_t *row = lp->bits + (size_t)r0 * lp->words;
+	for (int r = r0; r <= r1; r++, row += lp->words) {
+		if ((row[w0] & m0) | (row[w1] & m1)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void label_rect_mark(LabelPlacer *lp, int r0, int r1, int c0, int c1) {
+	if (c1 >= lp->width) c1 = lp->width - 1;
+	if (c0 < 0) c0 = 0;
+	for (int r = r0; r <= r1; r++) {
+		uint64_t *row = lp->bits + (size_t)r * lp->words;
+		for (int w = c0 / 64; w <= c1 / 64; w++) {
+			row[w] |= span_mask(w, c0, c1);
+		}
+	}
+}
+
+// Two-digit table for the integer formatter
+static const char digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Write v in decimal at p, two digits per step from the table; returns the end
+static char *format_int(char *p, int v) {
+	char buf[12];
+	char *q = buf + sizeof(buf);
+	unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+
+	while (u >= 100) {
+		unsigned int pair = (u % 100) * 2;
+		u /= 100;
+		*--q = digit_pairs[pair + 1];
+		*--q = digit_pairs[pair];
+	}
+	if (u >= 10) {
+		*--q = digit_pairs[u * 2 + 1];
+		*--q = digit_pairs[u * 2];
+	} else {
+		*--q = '0' + u;
+	}
+	if (v < 0) {
+		*--q = '-';
+	}
+
+	size_t len = buf + sizeof(buf) - q;
+	memcpy(p, q, len);
+	return p + len;
+}
+
+// One label line: prefix, value (tenths when tenths is set), suffix; cut
+// to size - 1 characters like snprintf, so an absurd value can't overrun
+static int format_label_line(char *line, size_t size, const char *prefix, int value, int tenths, const char *suffix) {
+	char buf[32];           // prefix and suffix are short, an int is 11 chars
+	char *p = buf;
+	while (*prefix) *p++ = *prefix++;
+	if (tenths) {
+		p = format_int(p, value / 10);
+		*p++ = '.';
+		*p++ = '0' + abs(value % 10);
+	} else {
+		p = format_int(p, value);
+	}
+	while (*suffix) *p++ = *suffix++;
+
+	size_t len = p - buf;
+	if (len > size - 1) {
+		len = size - 1;
+	}
+	memcpy(line, buf, len);
+	line[len] = '\0';
+	return (int)len;
+}
+
+static void label_update_width(Label *label) {
+	label->width = 0;
+	for (int i = 0; i < LABEL_LINES; i++) {
+		if (label->len[i] > label->width) label->width = label->len[i];
+	}
+}
+
+// Displayed values of a label, compared before anything is re-formatted
+static inline int label_altitude(const Aircraft *ac) { return (int)(ac->altitude * 3.28084); }
+static inline int label_speed(const Aircraft *ac) { return (int)(ac->velocity * 1.94384); }
+
+// Distance in tenths, rounded like "%.1f"; values within a hair of a tie go
+// through the exact printf rounding, everything else stays on the fast path
+static inline int label_distance(const Aircraft *ac) {
+	double tenths = ac->distance * 10.0;
+	int rounded = (int)(tenths + 0.5);
+	if (fabs(tenths - (rounded - 0.5)) < 1e-6) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.1f", ac->distance);
+		rounded = (int)(strtod(buf, NULL) * 10.0 + 0.5);
+	}
+	return rounded;
+}
+
+void format_label(Label *label, const Aircraft *ac) {
+	int i = 0;
+	for (; i < 8 && ac->callsign[i] != '\0'; i++) {
+		label->lines[0][i] = ac->callsign[i];
+	}
+	label->lines[0][i] = '\0';
+	label->len[0] = i;
+	label->len[1] = format_label_line(label->lines[1], sizeof(label->lines[1]), "Alt:", label_altitude(ac), 0, "ft");
+	label->len[2] = format_label_line(label->lines[2], sizeof(label->lines[2]), "Spd:", label_speed(ac), 0, "kt");
+	label->len[3] = format_label_line(label->lines[3], sizeof(label->lines[3]), "Dst:", label_distance(ac), 1, "nm");
+	label_update_width(label);
+}
+
+// Formatted labels by ICAO address, so a label is only re-formatted in the
+// fields whose displayed value changed. Entries unused for a few layers are
+// dropped when the table fills up.
+#define LABEL_CACHE_KEEP 4      // layers an unused entry survives
+
+typedef struct {
+	uint32_t icao24;
+	uint32_t used;              // layer number of the last use, 0 = empty
+	int altitude_ft;
+	int speed_kts;
+	int distance_tenths;
+	Label label;
+} LabelCacheEntry;
+
+typedef struct {
+	LabelCacheEntry *slots;     // open addressing, linear probing
+	size_t cap;                 // power of two
+	size_t count;
+	uint32_t layer;             // current layer number
+	uint64_t hits;              // labels reused unchanged
+	uint64_t fields;            // single fields re-formatted
+	uint64_t misses;            // labels formatted from scratch
+} LabelCache;
+
+static LabelCache label_cache;
+
+static inline size_t label_cache_hash(uint32_t icao24, size_t cap) {
+	return (size_t)((icao24 * 0x9E3779B1u) >> 8) & (cap - 1);
+}
+
+// Rebuild the table without stale entries, growing it if still too full
+static int label_cache_rehash(LabelCache *lc) {
+	size_t live = 0;
+	for (size_t i = 0; i < lc->cap; i++) {
+		if (lc->slots[i].used && lc->slots[i].used + LABEL_CACHE_KEEP >= lc->layer) {
+			live++;
+		}
+	}
+	size_t cap = lc->cap ? lc->cap : 256;
+	while ((live + 1) * 2 > cap) {
+		cap *= 2;
+	}
+
+	LabelCacheEntry *slots = calloc(cap, sizeof(LabelCacheEntry));
+	if (!slots) {
+		return -1;
+	}
+	for (size_t i = 0; i < lc->cap; i++) {
+		const LabelCacheEntry *e = &lc->slots[i];
+		if (e->used && e->used + LABEL_CACHE_KEEP >= lc->layer) {
+			size_t j = label_cache_hash(e->icao24, cap);
+			while (slots[j].used) {
+				j = (j + 1) & (cap - 1);
+			}
+			slots[j] = *e;
+		}
+	}
+	free(lc->slots);
+	lc->slots = slots;
+	lc->cap = cap;
+	lc->count = live;
+	return 0;
+}
+
+// Label for an aircraft, from the cache when its displayed values still match
+static const Label *label_lookup(LabelCache *lc, const Aircraft *ac, Label *scratch) {
+	if ((lc->count + 1) * 2 > lc->cap && label_cache_rehash(lc) < 0) {
+		format_label(scratch, ac);
+		return scratch;
+	}
+
+	size_t i = label_cache_hash(ac->icao24, lc->cap);
+	while (lc->slots[i].used && lc->slots[i].icao24 != ac->icao24) {
+		i = (i + 1) & (lc->cap - 1);
+	}
+	LabelCacheEntry *e = &lc->slots[i];
+
+	if (!e->used) {
+		lc->count++;
+		e->icao24 = ac->icao24;
+		e->altitude_ft = label_altitude(ac);
+		e->speed_kts = label_speed(ac);
+		e->distance_tenths = label_distance(ac);
+		format_label(&e->label, ac);
+		lc->misses++;
+	} else {
+		int changed = 0;
+		int altitude_ft = label_altitude(ac);
+		int speed_kts = label_speed(ac);
+		int distance_tenths = label_distance(ac);
+
+		if (strncmp(e->label.lines[0], ac->callsign, 8) != 0) {
+			format_label(&e->label, ac);
+			e->altitude_ft = altitude_ft;
+			e->speed_kts = speed_kts;
+			e->distance_tenths = distance_tenths;
+			lc->misses++;
+			e->used = lc->layer;
+			return &e->label;
+		}
+		if (altitude_ft != e->altitude_ft) {
+			e->altitude_ft = altitude_ft;
+			e->label.len[1] = format_label_line(e->label.lines[1], sizeof(e->label.lines[1]), "Alt:", altitude_ft, 0, "ft");
+			changed++;
+		}
+		if (speed_kts != e->speed_kts) {
+			e->speed_kts = speed_kts;
+			e->label.len[2] = format_label_line(e->label.lines[2], sizeof(e->label.lines[2]), "Spd:", speed_kts, 0, "kt");
+			changed++;
+		}
+		if (distance_tenths != e->distance_tenths) {
+			e->distance_tenths = distance_tenths;
+			e->label.len[3] = format_label_line(e->label.lines[3], sizeof(e->label.lines[3]), "Dst:", distance_tenths, 1, "nm");
+			changed++;
+		}
+		if (changed) {
+			label_update_width(&e->label);
+			lc->fields += changed;
+		} else {
+			lc->hits++;
+		}
+	}
+	e->used = lc->layer;
+	return &e->label;
+}
+
+// Try one position: dx/dy pick the corner (dx = 0 puts the label beside the
+// symbol), leader is the number of leader cells. Writes the label on success.
+static int try_label(LabelPlacer *lp, Matrix *matrix, const Label *label, int lines, int width,
+                     Footprint *fp, int dx, int dy, int leader) {
+	int x = fp->x, y = fp->y;
+	int lx = x + dx * 2 * leader;   // leader end, two columns per row keeps it diagonal
+	int ly = y + dy * leader;
+	int top, left;
+
+	if (dx == 0) {
+		// Beside the symbol, centered on its row
+		top = y - lines / 2;
+		left = dy > 0 ? x + 2 : x - 1 - width;
+	} else {
+		top = dy < 0 ? ly - lines : ly + 1;
+		left = dx > 0 ? lx : lx - width + 1;
+	}
+
+	// A spare column on each side keeps labels off neighbouring text and symbols
+	int pad = left > 0 ? 1 : 0;
+	if (!label_rect_free(lp, top, top + lines - 1, left - pad, left + width)) {
+		return 0;
+	}
+	for (int k = 1; k <= leader; k++) {
+		if (!label_rect_free(lp, y + dy * k, y + dy * k, x + dx * 2 * k, x + dx * 2 * k)) {
+			return 0;
+		}
+	}
+
+	char glyph = dx == dy ? '\\' : '/';
+	for (int k = 1; k <= leader; k++) {
+		int cx = x + dx * 2 * k, cy = y + dy * k;
+		matrix->data[cy][cx] = glyph;
+		label_rect_mark(lp, cy, cy, cx, cx);
+	}
+	for (int i = 0; i < lines; i++) {
+		memcpy(&matrix->data[top + i][left], label->lines[i], label->len[i]);
+	}
+	label_rect_mark(lp, top, top + lines - 1, left, left + width);
+
+	fp->top = top;
+	fp->left = left;
+	fp->lines = lines;
+	fp->width = width;
+	fp->dx = dx;
+	fp->dy = dy;
+	fp->leader = leader;
+	return 1;
+}
+
+// Candidate order: the classic above-right spot first, other corners and the
+// sides next, then the corners again on longer leader lines
+static const struct { int dx, dy, leader; } label_candidates[] = {
+	{1, -1, 1}, {0, 1, 0}, {-1, -1, 1}, {0, -1, 0}, {1, 1, 1}, {-1, 1, 1},
+	{1, -1, 2}, {-1, -1, 2}, {1, 1, 2}, {-1, 1, 2},
+	{1, -1, 3}, {-1, -1, 3}, {1, 1, 3}, {-1, 1, 3},
+};
+
+static void place_label(LabelPlacer *lp, Matrix *matrix, const Aircraft *ac, Footprint *fp) {
+	Label scratch;
+	const Label *label = label_lookup(&label_cache, ac, &scratch);
+
+	int n = sizeof(label_candidates) / sizeof(label_candidates[0]);
+	for (int pass = 0; pass < 2; pass++) {
+		// Last resort: the callsign alone
+		int lines = pass == 0 ? LABEL_LINES : 1;
+		int width = pass == 0 ? label->width : label->len[0];
+		for (int c = 0; c < n; c++) {
+			if (try_label(lp, matrix, label, lines, width, fp, label_candidates[c].dx,
+			              label_candidates[c].dy, label_candidates[c].leader)) {
+				if (lines == 1) lp->reduced++;
+				else if (label_candidates[c].leader > 1) lp->leadered++;
+				else lp->placed++;
+				return;
+			}
+		}
+	}
+	lp->dropped++;
+}
+
+static int compare_targets(const void *a, const void *b) {
+	const LabelTarget *ta = a, *tb = b;
+	return (ta->distance > tb->distance) - (ta->distance < tb->distance);
+}
+
+// Aircraft in heavy weather are listed in the top right corner, outside the
+// range ring, and aircraft in restricted airspace below them; labels keep
+// clear of both panels
+#define HAZARD_PANEL_WIDTH 26
+#define HAZARD_PANEL_ROWS 10    // heading, entries and a "more" line
+#define PANEL_WEATHER 0
+#define PANEL_AIRSPACE 1
+
+// Rows r0..r1 and columns c0..c1 of a panel; 0 when the screen is too small
+static int hazard_panel_rect(int height, int width, int panel, int *r0, int *r1, int *c0, int *c1) {
+	if (width < 3 * HAZARD_PANEL_WIDTH || height < (panel + 2) * HAZARD_PANEL_ROWS) {
+		return 0;
+	}
+	*r0 = 1 + panel * HAZARD_PANEL_ROWS;
+	*r1 = *r0 + HAZARD_PANEL_ROWS - 1;
+	*c0 = width - HAZARD_PANEL_WIDTH;
+	*c1 = width - 1;
+	return 1;
+}
+
+// Name of the weather source shown in the title and at startup
+const char *weather_source(const char *radar_dir) {
+	return radar_dir ? "Radar composite (ODIM-HDF5)" : "MeteoSwiss Radar (Simulated)";
+}
+
+// Redraw the aircraft layer (title, center marker, symbols and labels), keeping weather;
+// weather names the weather source, status, when not empty, is appended to the
+// title (e.g. replay time), and labels keep clear of the first `panels` side panels
+void draw_aircraft_layer(Matrix *matrix, Aircraft *aircraft_list, int aircraft_count,
+                         const char *weather, const char *status, int panels) {
+	LabelPlacer *lp = &label_placer;
+
+	// Clear only the aircraft data, keep weather
+	for (int i = 0; i < matrix->height; i++) {
+		for (int j = 0; j < matrix->width; j++) {
+			matrix->data[i][j] = ' ';
+		}
+	}
+	if (label_placer_begin(lp, matrix->height, matrix->width, aircraft_count) < 0) {
+		return;
+	}
+
+	// Display title at top
+	char title[160];
+	snprintf(title, sizeof(title), "%s - Aircraft: %d | Weather: %s%s%s",
+	         view.icao, aircraft_count, weather, status[0] ? " | " : "", status);
+	int title_len = 0;
+	for(; title[title_len] != '\0' && title_len < matrix->width; title_len++) {
+		matrix->data[0][title_len] = title[title_len];
+	}
+	label_rect_mark(lp, 0, 0, 0, title_len);
+	for (int panel = 0; panel < panels; panel++) {
+		int r0, r1, c0, c1;
+		if (hazard_panel_rect(matrix->height, matrix->width, panel, &r0, &r1, &c0, &c1)) {
+			label_rect_mark(lp, r0, r1, c0, c1);
+		}
+	}
+
+	// Draw center marker for the airport
+	int center_x_marker = matrix->width / 4;
+	int center_y_marker = matrix->height / 2;
+	if(center_y_marker >= 0 && center_y_marker < matrix->height && center_x_marker * 2 < matrix->width) {
+		matrix->data[center_y_marker][center_x_marker * 2] = '+';
+		label_rect_mark(lp, center_y_marker, center_y_marker, center_x_marker * 2, center_x_marker * 2);
+	}
+
+	// Symbols first, so no label can cover one
+	int targets = 0;
+	for(int i = 0; i < aircraft_count; i++) {
+		Aircraft *ac = &aircraft_list[i];
+		if(!aircraft_visible(ac)) {
+			continue;
+		}
+
+		int screen_x, screen_y;
+		if (!latlon_to_screen(ac->latitude, ac->longitude, &screen_x, &screen_y,
+		                      matrix->width, matrix->height)) {
+			continue;
+		}
+
+		display_symbol(matrix, screen_x, screen_y);
+		label_rect_mark(lp, screen_y, screen_y, screen_x * 2, screen_x * 2);
+
+		LabelTarget *t = &lp->targets[targets++];
+		t->index = i;
+		memset(&t->fp, 0, sizeof(t->fp));
+		t->fp.x = screen_x * 2;
+		t->fp.y = screen_y;
+		t->distance = ac->distance;
+	}
+
+	// Nearest aircraft get the first pick of label positions
+	label_cache.layer++;
+	if (targets > 1) {
+		qsort(lp->targets, targets, sizeof(LabelTarget), compare_targets);
+	}
+	for (int i = 0; i < targets; i++) {
+		LabelTarget *t = &lp->targets[i];
+		place_label(lp, matrix, &aircraft_list[t->index], &t->fp);
+	}
+	lp->target_count = targets;
+}
+
+// Per-aircraft tracks keyed by ICAO address. Each track keeps its last
+// TRAIL_LENGTH screen positions in a ring; the trail layer holds per-cell dot
+// counts so a new position changes at most three cells (new dot, one dot
+// fading to the older glyph, oldest dot erased) whatever the trail length.
+#define TRAIL_LENGTH 16
+#define TRAIL_LEVELS 2          // ':' for the newer half of a trail, '.' for the older
+#define TRACK_TIMEOUT_S 120     // tracks not reported for this long are dropped
+
+static const char trail_glyphs[TRAIL_LEVELS] = {':', '.'};
+
+typedef struct {
+	uint32_t icao24;
+	int used;
+	int64_t last_seen;          // report time of the newest position
+	int head;                   // ring index of the newest position
+	int len;
+	float lat[TRAIL_LENGTH];    // kept to re-rasterize after a resize
+	float lon[TRAIL_LENGTH];
+	int16_t x[TRAIL_LENGTH];    // matrix cell of each position
+	int16_t y[TRAIL_LENGTH];
+} Track;
+
+typedef struct {
+	Track *slots;               // open addressing, linear probing
+	size_t cap;                 // power of two
+	size_t count;
+	uint16_t *dots;             // TRAIL_LEVELS counts per cell
+	int width;
+	int height;
+	uint64_t cells_changed;
+	int *changed;               // cells whose glyph changed, y * width + x
+	size_t changed_count;
+	size_t changed_cap;
+} TrackTable;
+
+static inline size_t track_hash(uint32_t icao24, size_t cap) {
+	return (size_t)((icao24 * 0x9E3779B1u) >> 8) & (cap - 1);
+}
+
+// Recompute the glyph of one trail cell from its counts
+static void trail_cell_add(TrackTable *tt, Matrix *m, int x, int y, int level, int delta) {
+	uint16_t *dots = tt->dots + ((size_t)y * tt->width + x) * TRAIL_LEVELS;
+	dots[level] += delta;
+
+	char glyph = ' ';
+	for (int l = 0; l < TRAIL_LEVELS; l++) {
+		if (dots[l]) {
+			glyph = trail_glyphs[l];
+			break;
+		}
+	}
+	if (m->trail[y][x] != glyph) {
+		m->trail[y][x] = glyph;
+		tt->cells_changed++;
+		if (tt->changed_count == tt->changed_cap) {
+			size_t cap = tt->changed_cap ? tt->changed_cap * 2 : 1024;
+			int *changed = realloc(tt->changed, cap * sizeof(int));
+			if (!changed) {
+				return;
+			}
+			tt->changed = changed;
+			tt->changed_cap = cap;
+		}
+		tt->changed[tt->changed_count++] = y * m->width + x;
+	}
+}
+
+static inline int trail_level(int age) {
+	return age * TRAIL_LEVELS / TRAIL_LENGTH;
+}
+
+static Track *track_find(TrackTable *tt, uint32_t icao24, int create) {
+	if (create && (tt->count + 1) * 2 > tt->cap) {
+		size_t cap = tt->cap ? tt->cap * 2 : 256;
+		Track *slots = calloc(cap, sizeof(Track));
+		if (!slots) {
+			return NULL;
+		}
+		for (size_t i = 0; i < tt->cap; i++) {
+			if (tt->slots[i].used) {
+				size_t j = track_hash(tt->slots[i].icao24, cap);
+				while (slots[j].used) {
+					j = (j + 1) & (cap - 1);
+				}
+				slots[j] = tt->slots[i];
+			}
+		}
+		free(tt->slots);
+		tt->slots = slots;
+		tt->cap = cap;
+	}
+	if (tt->cap == 0) {
+		return NULL;
+	}
+
+	size_t i = track_hash(icao24, tt->cap);
+	while (tt->slots[i].used) {
+		if (tt->slots[i].icao24 == icao24) {
+			return &tt->slots[i];
+		}
+		i = (i + 1) & (tt->cap - 1);
+	}
+	if (!create) {
+		return NULL;
+	}
+	memset(&tt->slots[i], 0, sizeof(Track));
+	tt->slots[i].used = 1;
+	tt->slots[i].icao24 = icao24;
+	tt->slots[i].head = -1;
+	tt->count++;
+	return &tt->slots[i];
+}
+
+// Remove a track and its dots; later entries of the probe run are shifted back
+static void track_remove(TrackTable *tt, Matrix *m, size_t i) {
+	Track *t = &tt->slots[i];
+	for (int age = 0; age < t->len; age++) {
+		int k = (t->head - age + TRAIL_LENGTH) % TRAIL_LENGTH;
+		trail_cell_add(tt, m, t->x[k], t->y[k], trail_level(age), -1);
+	}
+	t->used = 0;
+	tt->count--;
+
+	size_t hole = i;
+	for (size_t j = (i + 1) & (tt->cap - 1); tt->slots[j].used; j = (j + 1) & (tt->cap - 1)) {
+		size_t home = track_hash(tt->slots[j].icao24, tt->cap);
+		// Move j into the hole unless its home lies cyclically in (hole, j]
+		if ((j > hole && (home <= hole || home > j)) || (j < hole && home <= hole && home > j)) {
+			tt->slots[hole] = tt->slots[j];
+			tt->slots[j].used = 0;
+			hole = j;
+		}
+	}
+}
+
+// Append a position to a track, touching only the cells whose dots change
+static void track_push(TrackTable *tt, Matrix *m, Track *t, double lat, double lon) {
+	int sx, sy;
+	if (!latlon_to_screen(lat, lon, &sx, &sy, m->width, m->height)) {
+		return;
+	}
+	sx *= 2;
+	if (t->len > 0 && t->x[t->head] == sx && t->y[t->head] == sy) {
+		return;
+	}
+
+	if (t->len == TRAIL_LENGTH) {
+		int oldest = (t->head + 1) % TRAIL_LENGTH;
+		trail_cell_add(tt, m, t->x[oldest], t->y[oldest], trail_level(TRAIL_LENGTH - 1), -1);
+		t->len--;
+	}
+	// Every point ages by one; only those crossing a level boundary change glyph
+	for (int l = 1; l < TRAIL_LEVELS; l++) {
+		int age = l * TRAIL_LENGTH / TRAIL_LEVELS - 1;
+		if (age < t->len) {
+			int k = (t->head - age + TRAIL_LENGTH) % TRAIL_LENGTH;
+			trail_cell_add(tt, m, t->x[k], t->y[k], l - 1, -1);
+			trail_cell_add(tt, m, t->x[k], t->y[k], l, 1);
+		}
+	}
+
+	t->head = (t->head + 1) % TRAIL_LENGTH;
+	t->len++;
+	t->lat[t->head] = lat;
+	t->lon[t->head] = lon;
+	t->x[t->head] = sx;
+	t->y[t->head] = sy;
+	trail_cell_add(tt, m, sx, sy, 0, 1);
+}
+
+// Fold a new aircraft list into the tracks and the trail layer of m
+void tracks_update(TrackTable *tt, Matrix *m, const Aircraft *aircraft_list, int aircraft_count) {
+	int64_t now = 0;
+	for (int i = 0; i < aircraft_count; i++) {
+		const Aircraft *ac = &aircraft_list[i];
+		if (ac->timestamp > now) {
+			now = ac->timestamp;
+		}
+		if (!aircraft_visible(ac)) {
+			continue;
+		}
+		Track *t = track_find(tt, ac->icao24, 1);
+		if (!t) {
+			continue;
+		}
+		t->last_seen = ac->timestamp;
+		track_push(tt, m, t, ac->latitude, ac->longitude);
+	}
+
+	for (size_t i = 0; i < tt->cap; i++) {
+		// Removal may shift a later track into slot i, so look at it again
+		while (tt->slots[i].used && tt->slots[i].last_seen < now - TRACK_TIMEOUT_S) {
+			track_remove(tt, m, i);
+		}
+	}
+}
+
+// Rebuild the trail layer of m for its size, e.g. after a resize
+int tracks_rasterize(TrackTable *tt, Matrix *m) {
+	uint16_t *dots = calloc((size_t)m->width * m->height * TRAIL_LEVELS, sizeof(uint16_t));
+	if (!dots) {
+		return -1;
+	}
+	free(tt->dots);
+	tt->dots = dots;
+	tt->width = m->width;
+	tt->height = m->height;
+
+	for (size_t i = 0; i < tt->cap; i++) {
+		Track *t = &tt->slots[i];
+		if (!t->used) {
+			continue;
+		}
+		// Replay the positions oldest first into the new geometry
+		float lat[TRAIL_LENGTH], lon[TRAIL_LENGTH];
+		int n = t->len;
+		for (int age = n - 1; age >= 0; age--) {
+			int k = (t->head - age + TRAIL_LENGTH) % TRAIL_LENGTH;
+			lat[n - 1 - age] = t->lat[k];
+			lon[n - 1 - age] = t->lon[k];
+		}
+		t->len = 0;
+		t->head = -1;
+		for (int k = 0; k < n; k++) {
+			track_push(tt, m, t, lat[k], lon[k]);
+		}
+	}
+	return 0;
+}
+
+// Forget all tracks, e.g. when replay jumps in time
+void tracks_clear(TrackTable *tt, Matrix *m) {
+	for (size_t i = 0; i < tt->cap; i++) {
+		tt->slots[i].used = 0;
+	}
+	tt->count = 0;
+	memset(tt->dots, 0, (size_t)tt->width * tt->height * TRAIL_LEVELS * sizeof(uint16_t));
+	for (int y = 0; y < m->height; y++) {
+		memset(m->trail[y], ' ', m->width);
+	}
+}
+
+void free_tracks(TrackTable *tt) {
+	free(tt->slots);
+	free(tt->dots);
+	free(tt->changed);
+}
+
+// Aeronautical overlay: airspace boundaries (polygons), runways and other
+// lines, and navaids (points) from local GeoJSON files, e.g. OpenAIP
+// exports. Files are mapped and scanned once in a single pass that keeps
+// only coordinates and geometry types, so no document tree is built. The
+// shapes are rasterized into a static layer once per view; the renderer
+// composites it under the aircraft layer and trails and over the weather.
+#define OVERLAY_MAX_FILES 4
+#define OVERLAY_MAX_DEPTH 32    // JSON nesting the scanner follows
+
+enum { OVERLAY_NONE, OVERLAY_H, OVERLAY_V, OVERLAY_RISE, OVERLAY_FALL,
+       OVERLAY_LINE_H, OVERLAY_LINE_V, OVERLAY_POINT, OVERLAY_GLYPHS };
+
+static const char *const overlay_chars[OVERLAY_GLYPHS] = {" ", "─", "│", "╱", "╲", "━", "┃", "◇"};
+static const char *const overlay_chars_ascii[OVERLAY_GLYPHS] = {" ", "-", "|", "/", "\\", "=", "H", "*"};
+
+typedef enum {
+	SHAPE_BOUNDARY,     // polygon rings
+	SHAPE_LINE,
+	SHAPE_POINT
+} ShapeKind;
+
+typedef struct {
+	int start;          // first point
+	int count;          // a MultiPoint keeps all its points in one shape
+	ShapeKind kind;
+	float min_lat, max_lat, min_lon, max_lon;
+} OverlayShape;
+
+// An airspace volume: the polygon rings of one feature between two altitudes.
+// Limits above the ground are taken as above sea level, terrain is not known.
+#define AIRSPACE_UNLIMITED_FT 1e6f
+
+typedef struct {
+	char name[16];
+	float floor_ft;
+	float ceiling_ft;
+	int restricted;     // restricted, danger or prohibited area
+	int first_shape;    // its rings are the boundary shapes among
+	int shape_count;    // first_shape .. first_shape + shape_count - 1
+	float min_lat, max_lat, min_lon, max_lon;
+} OverlayArea;
+
+typedef struct {
+	float *lat;
+	float *lon;
+	int point_count;
+	int point_cap;
+	OverlayShape *shapes;
+	int shape_count;
+	int shape_cap;
+	OverlayArea *areas;
+	int area_count;
+	int area_cap;
+	int files;
+	double load_ms;     // all files, mapping and scanning
+} Overlay;
+
+typedef struct {
+	const char *base;
+	const char *p;
+	const char *end;
+	const char *path;
+	Overlay *ov;
+	int error;
+} GeoScan;
+
+void free_overlay(Overlay *ov) {
+	free(ov->lat);
+	free(ov->lon);
+	free(ov->shapes);
+	free(ov->areas);
+	memset(ov, 0, sizeof(*ov));
+}
+
+static void geo_fail(GeoScan *s, const char *what) {
+	if (!s->error) {
+		fprintf(stderr, "overlay: %s: %s at byte %ld\n", s->path, what, (long)(s->p - s->base));
+	}
+	s->error = 1;
+	s->p = s->end;
+}
+
+static inline void geo_ws(GeoScan *s) {
+	while (s->p < s->end && (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t')) {
+		s->p++;
+	}
+}
+
+// A string at s->p; its raw contents, escapes left as they are
+static int geo_string(GeoScan *s, const char **str, size_t *len) {
+	if (s->p >= s->end || *s->p != '"') {
+		geo_fail(s, "string expected");
+		return -1;
+	}
+	const char *start = ++s->p;
+	while (s->p < s->end && *s->p != '"') {
+		s->p += *s->p == '\\' ? 2 : 1;
+	}
+	if (s->p >= s->end) {
+		geo_fail(s, "unterminated string");
+		return -1;
+	}
+	*str = start;
+	*len = (size_t)(s->p - start);
+	s->p++;
+	return 0;
+}
+
+// A JSON number, parsed within the mapping (which has no terminator)
+static int geo_number(GeoScan *s, double *value) {
+	const char *p = s->p;
+	int negative = 0;
+	if (p < s->end && (*p == '-' || *p == '+')) {
+		negative = *p++ == '-';
+	}
+	double v = 0;
+	int digits = 0;
+	for (; p < s->end && *p >= '0' && *p <= '9'; p++, digits++) {
+		v = v * 10 + (*p - '0');
+	}
+	if (p < s->end && *p == '.') {
+		double f = 0.1;
+		for (p++; p < s->end && *p >= '0' && *p <= '9'; p++, digits++) {
+			v += (*p - '0') * f;
+			f *= 0.1;
+		}
+	}
+	if (digits == 0) {
+		geo_fail(s, "number expected");
+		return -1;
+	}
+	if (p < s->end && (*p == 'e' || *p == 'E')) {
+		int exp_negative = 0, e = 0;
+		p++;
+		if (p < s->end && (*p == '-' || *p == '+')) {
+			exp_negative = *p++ == '-';
+		}
+		for (; p < s->end && *p >= '0' && *p <= '9'; p++) {
+			e = e < 400 ? e * 10 + (*p - '0') : e;
+		}
+		v *= pow(10.0, exp_negative ? -e : e);
+	}
+	*value = negative ? -v : v;
+	s->p = p;
+	return 0;
+}
+
+static int overlay_add_point(Overlay *ov, double lat, double lon) {
+	if (ov->point_count == ov->point_cap) {
+		int cap = ov->point_cap ? ov->point_cap * 2 : 4096;
+		float *la = realloc(ov->lat, cap * sizeof(float));
+		if (la) ov->lat = la;
+		float *lo = realloc(ov->lon, cap * sizeof(float));
+		if (lo) ov->lon = lo;
+		if (!la || !lo) {
+			return -1;
+		}
+		ov->point_cap = cap;
+	}
+	ov->lat[ov->point_count] = (float)lat;
+	ov->lon[ov->point_count] = (float)lon;
+	ov->point_count++;
+	return 0;
+}
+
+// Points start..point_count become a shape, kind settled by the caller
+static int overlay_add_shape(Overlay *ov, int start) {
+	if (ov->shape_count == ov->shape_cap) {
+		int cap = ov->shape_cap ? ov->shape_cap * 2 : 256;
+		OverlayShape *shapes = realloc(ov->shapes, cap * sizeof(OverlayShape));
+		if (!shapes) {
+			return -1;
+		}
+		ov->shapes = shapes;
+		ov->shape_cap = cap;
+	}
+	OverlayShape *sh = &ov->shapes[ov->shape_count++];
+	sh->start = start;
+	sh->count = ov->point_count - start;
+	sh->kind = SHAPE_LINE;
+	sh->min_lat = sh->max_lat = ov->lat[start];
+	sh->min_lon = sh->max_lon = ov->lon[start];
+	for (int i = start + 1; i < ov->point_count; i++) {
+		if (ov->lat[i] < sh->min_lat) sh->min_lat = ov->lat[i];
+		if (ov->lat[i] > sh->max_lat) sh->max_lat = ov->lat[i];
+		if (ov->lon[i] < sh->min_lon) sh->min_lon = ov->lon[i];
+		if (ov->lon[i] > sh->max_lon) sh->max_lon = ov->lon[i];
+	}
+	return 0;
+}
+
+// A coordinates array of any depth: every innermost list of positions is
+// one shape; returns 1 for a bare position, which the caller closes
+static int geo_coordinates(GeoScan *s, int depth) {
+	if (depth > OVERLAY_MAX_DEPTH || s->p >= s->end || *s->p != '[') {
+		geo_fail(s, "coordinates expected");
+		return -1;
+	}
+	s->p++;
+	geo_ws(s);
+	Overlay *ov = s->ov;
+	int start = ov->point_count;
+
+	if (s->p < s->end && *s->p != '[' && *s->p != ']') {
+		// A position: longitude, latitude and an ignored altitude
+		double v[3];
+		int n = 0;
+		for (;;) {
+			double value;
+			if (geo_number(s, &value) < 0) {
+				return -1;
+			}
+			if (n < 3) v[n++] = value;
+			geo_ws(s);
+			if (s->p < s->end && *s->p == ',') {
+				s->p++;
+				geo_ws(s);
+				continue;
+			}
+			break;
+		}
+		if (s->p >= s->end || *s->p != ']' || n < 2) {
+			geo_fail(s, "bad position");
+			return -1;
+		}
+		s->p++;
+		if (overlay_add_point(ov, v[1], v[0]) < 0) {
+			geo_fail(s, "out of memory");
+			return -1;
+		}
+		return 1;
+	}
+
+	int positions = 0;
+	while (s->p < s->end && *s->p != ']') {
+		int r = geo_coordinates(s, depth + 1);
+		if (r < 0) {
+			return -1;
+		}
+		positions += r;
+		geo_ws(s);
+		if (s->p < s->end && *s->p == ',') {
+			s->p++;
+			geo_ws(s);
+		}
+	}
+	if (s->p >= s->end) {
+		geo_fail(s, "unterminated array");
+		return -1;
+	}
+	s->p++;
+	if (positions > 0 && overlay_add_shape(ov, start) < 0) {
+		geo_fail(s, "out of memory");
+		return -1;
+	}
+	return 0;
+}
+
+// Boundary shapes first..shape_count of a feature become an area
+static int overlay_add_area(Overlay *ov, int first, const OverlayArea *props) {
+	int rings = 0;
+	OverlayArea area = *props;
+	for (int i = first; i < ov->shape_count; i++) {
+		const OverlayShape *sh = &ov->shapes[i];
+		if (sh->kind != SHAPE_BOUNDARY) {
+			continue;
+		}
+		if (rings++ == 0) {
+			area.min_lat = sh->min_lat;
+			area.max_lat = sh->max_lat;
+			area.min_lon = sh->min_lon;
+			area.max_lon = sh->max_lon;
+		}
+		area.min_lat = fminf(area.min_lat, sh->min_lat);
+		area.max_lat = fmaxf(area.max_lat, sh->max_lat);
+		area.min_lon = fminf(area.min_lon, sh->min_lon);
+		area.max_lon = fmaxf(area.max_lon, sh->max_lon);
+	}
+	if (rings == 0) {
+		return 0;
+	}
+	if (ov->area_count == ov->area_cap) {
+		int cap = ov->area_cap ? ov->area_cap * 2 : 64;
+		OverlayArea *areas = realloc(ov->areas, cap * sizeof(OverlayArea));
+		if (!areas) {
+			return -1;
+		}
+		ov->areas = areas;
+		ov->area_cap = cap;
+	}
+	area.first_shape = first;
+	area.shape_count = ov->shape_count - first;
+	ov->areas[ov->area_count++] = area;
+	return 0;
+}
+
+static inline int geo_is(const char *str, size_t len, const char *literal) {
+	return len == strlen(literal) && strncasecmp(str, literal, len) == 0;
+}
+
+static int geo_value(GeoScan *s, int depth);
+
+// An altitude limit in feet: a number of feet, text such as "GND", "FL95",
+// "4500ft" or "1200m", or an object with a value and a unit (OpenAIP codes
+// the unit 0 for metres, 1 for feet and 6 for flight levels)
+static int geo_limit(GeoScan *s, int depth, float *feet) {
+	const char *str, *key;
+	size_t len, key_len;
+	double value;
+
+	geo_ws(s);
+	if (s->p < s->end && *s->p == '"') {
+		if (geo_string(s, &str, &len) < 0) {
+			return -1;
+		}
+		if (geo_is(str, len, "GND") || geo_is(str, len, "SFC")) {
+			*feet = 0;
+		} else if (len >= 3 && strncasecmp(str, "UNL", 3) == 0) {
+			*feet = AIRSPACE_UNLIMITED_FT;
+		} else {
+			int fl = len > 2 && strncasecmp(str, "FL", 2) == 0;
+			size_t i = fl ? 2 : 0;
+			for (value = 0; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+				value = value * 10 + (str[i] - '0');
+			}
+			while (i < len && str[i] == ' ') {
+				i++;
+			}
+			if (i > (fl ? 2u : 0u)) {
+				*feet = (float)(fl ? value * 100 : i < len && (str[i] == 'm' || str[i] == 'M') ? value * 3.28084 : value);
+			}
+		}
+		return 0;
+	}
+	if (s->p < s->end && (*s->p == '-' || (*s->p >= '0' && *s->p <= '9'))) {
+		if (geo_number(s, &value) < 0) {
+			return -1;
+		}
+		*feet = (float)value;
+		return 0;
+	}
+	if (s->p >= s->end || *s->p != '{') {
+		return geo_value(s, depth);
+	}
+
+	double unit = 1;    // feet per unit
+	int have_value = 0;
+	s->p++;
+	geo_ws(s);
+	while (s->p < s->end && *s->p != '}') {
+		if (geo_string(s, &key, &key_len) < 0) {
+			return -1;
+		}
+		geo_ws(s);
+		if (s->p >= s->end || *s->p != ':') {
+			geo_fail(s, "':' expected");
+			return -1;
+		}
+		s->p++;
+		geo_ws(s);
+		if (geo_is(key, key_len, "value") && s->p < s->end && (*s->p == '-' || (*s->p >= '0' && *s->p <= '9'))) {
+			if (geo_number(s, &value) < 0) {
+				return -1;
+			}
+			have_value = 1;
+		} else if (geo_is(key, key_len, "unit") && s->p < s->end && *s->p == '"') {
+			if (geo_string(s, &str, &len) < 0) {
+				return -1;
+			}
+			unit = geo_is(str, len, "FL") ? 100 : geo_is(str, len, "M") ? 3.28084 : 1;
+		} else if (geo_is(key, key_len, "unit") && s->p < s->end && *s->p >= '0' && *s->p <= '9') {
+			double code;
+			if (geo_number(s, &code) < 0) {
+				return -1;
+			}
+			unit = code == 6 ? 100 : code == 0 ? 3.28084 : 1;
+		} else if (geo_value(s, depth + 1) < 0) {
+			return -1;
+		}
+		geo_ws(s);
+		if (s->p < s->end && *s->p == ',') {
+			s->p++;
+			geo_ws(s);
+		}
+	}
+	if (s->p >= s->end) {
+		geo_fail(s, "unterminated object");
+		return -1;
+	}
+	s->p++;
+	if (have_value) {
+		*feet = (float)(value * unit);
+	}
+	return 0;
+}
+
+// A feature's properties: name, vertical limits and whether it is a
+// restricted, danger or prohibited area; everything else is skipped
+static int geo_properties(GeoScan *s, int depth, OverlayArea *area) {
+	s->p++;
+	geo_ws(s);
+	while (s->p < s->end && *s->p != '}') {
+		const char *key, *str;
+		size_t key_len, len;
+		if (geo_string(s, &key, &key_len) < 0) {
+			return -1;
+		}
+		geo_ws(s);
+		if (s->p >= s->end || *s->p != ':') {
+			geo_fail(s, "':' expected");
+			return -1;
+		}
+		s->p++;
+		geo_ws(s);
+
+		if (geo_is(key, key_len, "name") && s->p < s->end && *s->p == '"') {
+			if (geo_string(s, &str, &len) < 0) {
+				return -1;
+			}
+			// Kept to printable ASCII, one cell per character: an escape
+			// stands for the character after the backslash, and anything
+			// else (a \uXXXX escape or a UTF-8 sequence) for a '?'
+			size_t n = 0;
+			for (size_t i = 0; i < len && n + 1 < sizeof(area->name); i++) {
+				unsigned char ch = (unsigned char)str[i];
+				if (ch == '\\' && i + 1 < len) {
+					ch = (unsigned char)str[++i];
+					if (ch == 'u') {
+						i += i + 4 < len ? 4 : 0;
+						ch = '?';
+					}
+				} else if (ch >= 0x80) {
+					if (ch < 0xC0) {
+						continue;
+					}
+					ch = '?';
+				}
+				area->name[n++] = ch >= ' ' && ch < 0x7F ? (char)ch : '?';
+			}
+			area->name[n] = '\0';
+		} else if (geo_is(key, key_len, "lowerLimit") || geo_is(key, key_len, "lower_limit") ||
+		           geo_is(key, key_len, "floor")) {
+			if (geo_limit(s, depth + 1, &area->floor_ft) < 0) {
+				return -1;
+			}
+		} else if (geo_is(key, key_len, "upperLimit") || geo_is(key, key_len, "upper_limit") ||
+		           geo_is(key, key_len, "ceiling")) {
+			if (geo_limit(s, depth + 1, &area->ceiling_ft) < 0) {
+				return -1;
+			}
+		} else if (geo_is(key, key_len, "type") && s->p < s->end && *s->p == '"') {
+			if (geo_string(s, &str, &len) < 0) {
+				return -1;
+			}
+			area->restricted = geo_is(str, len, "R") || geo_is(str, len, "P") || geo_is(str, len, "D") ||
+			                   geo_is(str, len, "RESTRICTED") || geo_is(str, len, "PROHIBITED") ||
+			                   geo_is(str, len, "DANGER");
+		} else if (geo_is(key, key_len, "type") && s->p < s->end && (*s->p == '-' || (*s->p >= '0' && *s->p <= '9'))) {
+			double code;
+			if (geo_number(s, &code) < 0) {
+				return -1;
+			}
+			area->restricted = code >= 1 && code <= 3;  // OpenAIP: restricted, danger, prohibited
+		} else if (geo_value(s, depth + 1) < 0) {
+			return -1;
+		}
+		geo_ws(s);
+		if (s->p < s->end && *s->p == ',') {
+			s->p++;
+			geo_ws(s);
+		}
+	}
+	if (s->p >= s->end) {
+		geo_fail(s, "unterminated object");
+		return -1;
+	}
+	s->p++;
+	return 0;
+}
+
+// An object; geometries ("type" and "coordinates" side by side, in either
+// order) turn into shapes of the kind their type names, and the polygons of
+// a feature into an area with the limits from its properties
+static int geo_object(GeoScan *s, int depth) {
+	s->p++;
+	geo_ws(s);
+	Overlay *ov = s->ov;
+	int first_shape = -1;
+	ShapeKind kind = SHAPE_LINE;
+	int typed = 0;
+	int feature_shapes = -1;
+	OverlayArea props = {.floor_ft = -AIRSPACE_UNLIMITED_FT, .ceiling_ft = AIRSPACE_UNLIMITED_FT};
+
+	while (s->p < s->end && *s->p != '}') {
+		const char *key, *str;
+		size_t key_len, len;
+		if (geo_string(s, &key, &key_len) < 0) {
+			return -1;
+		}
+		geo_ws(s);
+		if (s->p >= s->end || *s->p != ':') {
+			geo_fail(s, "':' expected");
+			return -1;
+		}
+		s->p++;
+		geo_ws(s);
+
+		if (key_len == 11 && memcmp(key, "coordinates", 11) == 0) {
+			int shapes = ov->shape_count, points = ov->point_count;
+			int r = geo_coordinates(s, depth + 1);
+			if (r < 0) {
+				return -1;
+			}
+			if (r == 1 && overlay_add_shape(ov, points) < 0) {
+				geo_fail(s, "out of memory");
+				return -1;
+			}
+			first_shape = shapes;
+		} else if (key_len == 4 && memcmp(key, "type", 4) == 0 && s->p < s->end && *s->p == '"') {
+			if (geo_string(s, &str, &len) < 0) {
+				return -1;
+			}
+			typed = 1;
+			if ((len == 5 && memcmp(str, "Point", 5) == 0) || (len == 10 && memcmp(str, "MultiPoint", 10) == 0)) {
+				kind = SHAPE_POINT;
+			} else if ((len == 7 && memcmp(str, "Polygon", 7) == 0) ||
+			           (len == 12 && memcmp(str, "MultiPolygon", 12) == 0)) {
+				kind = SHAPE_BOUNDARY;
+			} else {
+				kind = SHAPE_LINE;
+			}
+		} else if (key_len == 10 && memcmp(key, "properties", 10) == 0 && s->p < s->end && *s->p == '{') {
+			if (depth > OVERLAY_MAX_DEPTH) {
+				geo_fail(s, "nested too deeply");
+				return -1;
+			}
+			if (geo_properties(s, depth + 1, &props) < 0) {
+				return -1;
+			}
+		} else if (key_len == 8 && memcmp(key, "geometry", 8) == 0) {
+			feature_shapes = ov->shape_count;
+			if (geo_value(s, depth + 1) < 0) {
+				return -1;
+			}
+		} else if (geo_value(s, depth + 1) < 0) {
+			return -1;
+		}
+		geo_ws(s);
+		if (s->p < s->end && *s->p == ',') {
+			s->p++;
+			geo_ws(s);
+		}
+	}
+	if (s->p >= s->end) {
+		geo_fail(s, "unterminated object");
+		return -1;
+	}
+	s->p++;
+
+	if (first_shape >= 0 && typed) {
+		for (int i = first_shape; i < ov->shape_count; i++) {
+			ov->shapes[i].kind = kind;
+		}
+	}
+	if (feature_shapes >= 0 && overlay_add_area(ov, feature_shapes, &props) < 0) {
+		geo_fail(s, "out of memory");
+		return -1;
+	}
+	return 0;
+}
+
+// Any value, descending into objects and arrays and skipping the rest
+static int geo_value(GeoScan *s, int depth) {
+	if (depth > OVERLAY_MAX_DEPTH) {
+		geo_fail(s, "nested too deeply");
+		return -1;
+	}
+	geo_ws(s);
+	if (s->p >= s->end) {
+		geo_fail(s, "value expected");
+		return -1;
+	}
+	const char *str;
+	size_t len;
+	double number;
+	switch (*s->p) {
+		case '{':
+			return geo_object(s, depth);
+		case '[':
+			s->p++;
+			geo_ws(s);
+			while (s->p < s->end && *s->p != ']') {
+				if (geo_value(s, depth + 1) < 0) {
+					return -1;
+				}
+				geo_ws(s);
+				if (s->p < s->end && *s->p == ',') {
+					s->p++;
+				}
+				geo_ws(s);
+			}
+			if (s->p >= s->end) {
+				geo_fail(s, "unterminated array");
+				return -1;
+			}
+			s->p++;
+			return 0;
+		case '"':
+			return geo_string(s, &str, &len);
+		case 't':
+		case 'n':
+		case 'f':
+			len = *s->p == 'f' ? 5 : 4;
+			if ((size_t)(s->end - s->p) < len) {
+				geo_fail(s, "bad literal");
+				return -1;
+			}
+			s->p += len;
+			return 0;
+		default:
+			return geo_number(s, &number);
+	}
+}
+
+// Map a GeoJSON file and add its shapes to the overlay
+int overlay_load(Overlay *ov, const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "overlay: cannot open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+		fprintf(stderr, "overlay: %s is empty\n", path);
+		close(fd);
+		return -1;
+	}
+	const char *base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "overlay: cannot map %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	madvise((void *)base, sb.st_size, MADV_SEQUENTIAL);
+
+	GeoScan s = {base, base, base + sb.st_size, path, ov, 0};
+	int shapes = ov->shape_count, points = ov->point_count, areas = ov->area_count;
+	geo_value(&s, 0);
+	munmap((void *)base, sb.st_size);
+	if (s.error) {
+		ov->shape_count = shapes;
+		ov->point_count = points;
+		ov->area_count = areas;
+		return -1;
+	}
+	ov->files++;
+	return 0;
+}
+
+// Position on screen in columns and rows from the center marker, before the
+// truncation latlon_to_screen applies, so lines can pass between cells
+static inline void overlay_project(double lat, double lon, double scale, double *x, double *y) {
+	double x_nm, y_nm;
+	project(lat, lon, &x_nm, &y_nm);
+	*x = 2.0 * x_nm * scale;
+	*y = y_nm * scale;
+}
+
+static inline void overlay_put(uint8_t *cells, int width, int height, double x, double y, uint8_t glyph) {
+	// Truncated toward the marker like latlon_to_screen
+	int col = (width / 4) * 2 + (int)x;
+	int row = height / 2 - (int)y;
+	if (col < 0 || col >= width || row < 1 || row >= height) {
+		return;
+	}
+	// Navaids over lines over boundaries
+	uint8_t *cell = &cells[(size_t)row * width + col];
+	int rank = glyph == OVERLAY_POINT ? 2 : glyph >= OVERLAY_LINE_H ? 1 : 0;
+	int have = *cell == OVERLAY_NONE ? -1 : *cell == OVERLAY_POINT ? 2 : *cell >= OVERLAY_LINE_H ? 1 : 0;
+	if (rank >= have) {
+		*cell = glyph;
+	}
+}
+
+// Whether a shape's latitude/longitude box comes within reach_nm of the view
+// center. The nearest point of the box lies on the center's meridian when
+// the box spans it, otherwise on the nearer side meridian, where the closest
+// point of the great circle is clamped into the box.
+static int overlay_box_in_reach(const OverlayShape *sh, double reach_nm) {
+	double lat = view.lat, lon = view.lon;
+	// Latitude difference alone bounds the distance, without any trigonometry
+	if (fmax(sh->min_lat - lat, lat - sh->max_lat) * 60.0 > reach_nm) {
+		return 0;
+	}
+	if (lon < sh->min_lon || lon > sh->max_lon) {
+		lon = view.lon < sh->min_lon ? sh->min_lon : sh->max_lon;
+		double dlon = (lon - view.lon) * M_PI / 180.0;
+		if (cos(dlon) > 0) {
+			lat = atan(view.sin_lat / view.cos_lat / cos(dlon)) * 180.0 / M_PI;
+		}
+	}
+	lat = lat < sh->min_lat ? sh->min_lat : (lat > sh->max_lat ? sh->max_lat : lat);
+	return calculate_distance(view.lat, view.lon, lat, lon) <= reach_nm;
+}
+
+// Rasterize the overlay for a width x height view into cells, one glyph per cell
+void overlay_rasterize(const Overlay *ov, uint8_t *cells, int width, int height) {
+	double scale = screen_scale(width, height);
+	double half_x = width / 2.0 + 1, half_y = height / 2.0 + 1;
+	// Nothing farther from the center than the screen corner can show
+	double reach_nm = sqrt(half_x * half_x / 4 + half_y * half_y) / scale;
+
+	memset(cells, OVERLAY_NONE, (size_t)width * height);
+	for (int i = 0; i < ov->shape_count; i++) {
+		const OverlayShape *sh = &ov->shapes[i];
+		// Shapes wholly off screen are dropped on their bounding box; projected
+		// boxes are curved, so the test is on distance from the center
+		double x0, y0, x1, y1;
+		if (!overlay_box_in_reach(sh, reach_nm)) {
+			continue;
+		}
+
+		if (sh->kind == SHAPE_POINT) {
+			for (int k = 0; k < sh->count; k++) {
+				overlay_project(ov->lat[sh->start + k], ov->lon[sh->start + k], scale, &x0, &y0);
+				overlay_put(cells, width, height, x0, y0, OVERLAY_POINT);
+			}
+			continue;
+		}
+		overlay_project(ov->lat[sh->start], ov->lon[sh->start], scale, &x0, &y0);
+		for (int k = 1; k < sh->count; k++) {
+			overlay_project(ov->lat[sh->start + k], ov->lon[sh->start + k], scale, &x1, &y1);
+			double dx = x1 - x0, dy = y1 - y0;
+			// Direction on screen, where a column is half as wide as a row
+			double ax = fabs(dx) / 2, ay = fabs(dy);
+			uint8_t glyph;
+			if (ay <= 0.4142 * ax) {
+				glyph = sh->kind == SHAPE_LINE ? OVERLAY_LINE_H : OVERLAY_H;
+			} else if (ax <= 0.4142 * ay) {
+				glyph = sh->kind == SHAPE_LINE ? OVERLAY_LINE_V : OVERLAY_V;
+			} else {
+				glyph = (dx > 0) == (dy > 0) ? OVERLAY_RISE : OVERLAY_FALL;
+			}
+			int steps = (int)ceil(fmax(fabs(dx), fabs(dy)));
+			// Segments far off screen are not walked cell by cell
+			if (fmax(x0, x1) >= -half_x && fmin(x0, x1) <= half_x &&
+			    fmax(y0, y1) >= -half_y && fmin(y0, y1) <= half_y) {
+				for (int j = 0; j <= steps; j++) {
+					double t = steps ? (double)j / steps : 0;
+					overlay_put(cells, width, height, x0 + dx * t, y0 + dy * t, glyph);
+				}
+			}
+			x0 = x1;
+			y0 = y1;
+		}
+	}
+}
+
+// Airspace classification: a coarse grid over all areas lists, per cell,
+// the areas that cover it wholly and, for areas whose boundary crosses it,
+// the edges inside the cell and whether the cell center is inside. A point
+// in a boundary cell is then tested exactly against the few local edges by
+// counting those the line from the cell center to the point crosses, so a
+// lookup never walks a whole polygon.
+#define AIRSPACE_MAX_CELLS (1 << 20)
+#define AIRSPACE_EDGES_PER_CELL 2
+
+typedef struct {
+	int area;
+	int p;              // edge from point p to point q, p < 0 when the cell is wholly inside
+	int q;
+	int inside;         // the cell center is inside the area
+} AirspaceEntry;
+
+typedef struct {
+	int cell;
+	AirspaceEntry entry;
+} AirspaceRecord;
+
+typedef struct {
+	double lat0;        // south-west corner of the grid
+	double lon0;
+	double cell_lat;    // cell size in degrees
+	double cell_lon;
+	int nx;
+	int ny;
+	int *start;         // entries of cell c are start[c] .. start[c + 1] - 1, areas grouped
+	AirspaceEntry *entries;
+	int entry_count;
+	double build_ms;
+} AirspaceMask;
+
+void free_airspace_mask(AirspaceMask *am) {
+	free(am->start);
+	free(am->entries);
+	memset(am, 0, sizeof(*am));
+}
+
+// Growable scratch arrays for the build
+typedef struct {
+	AirspaceRecord *records;
+	int count;
+	int cap;
+	double *crossings;
+	int crossing_count;
+	int crossing_cap;
+} AirspaceBuild;
+
+static int airspace_record(AirspaceBuild *b, int cell, int area, int p, int q) {
+	if (b->count == b->cap) {
+		int cap = b->cap ? b->cap * 2 : 4096;
+		AirspaceRecord *records = realloc(b->records, cap * sizeof(AirspaceRecord));
+		if (!records) {
+			return -1;
+		}
+		b->records = records;
+		b->cap = cap;
+	}
+	b->records[b->count++] = (AirspaceRecord){cell, {area, p, q, 0}};
+	return 0;
+}
+
+static int airspace_crossing(AirspaceBuild *b, double x) {
+	if (b->crossing_count == b->crossing_cap) {
+		int cap = b->crossing_cap ? b->crossing_cap * 2 : 256;
+		double *crossings = realloc(b->crossings, cap * sizeof(double));
+		if (!crossings) {
+			return -1;
+		}
+		b->crossings = crossings;
+		b->crossing_cap = cap;
+	}
+	b->crossings[b->crossing_count++] = x;
+	return 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double da = *(const double *)a, db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+static inline double airspace_gx(const AirspaceMask *am, double lon) { return (lon - am->lon0) / am->cell_lon; }
+static inline double airspace_gy(const AirspaceMask *am, double lat) { return (lat - am->lat0) / am->cell_lat; }
+
+// Edge k of a ring ends at the next point, the last one closes the ring
+static inline int ring_next(const OverlayShape *sh, int k) {
+	return sh->start + (k + 1 < sh->count ? k + 1 : 0);
+}
+
+// Record edge p-q in every cell it touches, a row of cells at a time
+static int airspace_cover(AirspaceBuild *b, const AirspaceMask *am, const Overlay *ov, int area, int p, int q) {
+	double x0 = airspace_gx(am, ov->lon[p]), y0 = airspace_gy(am, ov->lat[p]);
+	double x1 = airspace_gx(am, ov->lon[q]), y1 = airspace_gy(am, ov->lat[q]);
+	if (y0 > y1) {
+		double t = x0; x0 = x1; x1 = t;
+		t = y0; y0 = y1; y1 = t;
+	}
+	int r0 = (int)y0, r1 = (int)y1;
+	r0 = r0 < 0 ? 0 : r0 >= am->ny ? am->ny - 1 : r0;
+	r1 = r1 < 0 ? 0 : r1 >= am->ny ? am->ny - 1 : r1;
+	for (int r = r0; r <= r1; r++) {
+		double xa = x0, xb = x1;
+		if (y1 > y0) {
+			double ya = fmax(y0, r), yb = fmin(y1, r + 1);
+			xa = x0 + (ya - y0) * (x1 - x0) / (y1 - y0);
+			xb = x0 + (yb - y0) * (x1 - x0) / (y1 - y0);
+		}
+		if (xa > xb) {
+			double t = xa; xa = xb; xb = t;
+		}
+		// A hair wider, so an edge along a cell border is in both cells
+		int c0 = (int)floor(xa - 1e-9), c1 = (int)floor(xb + 1e-9);
+		c0 = c0 < 0 ? 0 : c0;
+		c1 = c1 >= am->nx ? am->nx - 1 : c1;
+		for (int c = c0; c <= c1; c++) {
+			if (airspace_record(b, r * am->nx + c, area, p, q) < 0) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Edges, then wholly covered cells, of one area. Cell centers are classified
+// a row at a time by the crossings of the rings with the row's center line.
+static int airspace_add_area(AirspaceBuild *b, const AirspaceMask *am, const Overlay *ov, int a,
+                             int *stamp, uint8_t *parity) {
+	const OverlayArea *area = &ov->areas[a];
+	int first = b->count;
+	for (int i = area->first_shape; i < area->first_shape + area->shape_count; i++) {
+		const OverlayShape *sh = &ov->shapes[i];
+		if (sh->kind != SHAPE_BOUNDARY) {
+			continue;
+		}
+		for (int k = 0; k < sh->count; k++) {
+			int p = sh->start + k, q = ring_next(sh, k);
+			if ((ov->lat[p] != ov->lat[q] || ov->lon[p] != ov->lon[q]) &&
+			    airspace_cover(b, am, ov, a, p, q) < 0) {
+				return -1;
+			}
+		}
+	}
+	int edges_end = b->count;
+	for (int i = first; i < edges_end; i++) {
+		stamp[b->records[i].cell] = a;
+	}
+
+	// One column more each side for edges on the border of the bounding box
+	int r0 = (int)airspace_gy(am, area->min_lat), r1 = (int)airspace_gy(am, area->max_lat);
+	int c0 = (int)airspace_gx(am, area->min_lon) - 1, c1 = (int)airspace_gx(am, area->max_lon) + 1;
+	r1 = r1 >= am->ny ? am->ny - 1 : r1;
+	c0 = c0 < 0 ? 0 : c0;
+	c1 = c1 >= am->nx ? am->nx - 1 : c1;
+	for (int r = r0; r <= r1; r++) {
+		double yc = r + 0.5;
+		b->crossing_count = 0;
+		for (int i = area->first_shape; i < area->first_shape + area->shape_count; i++) {
+			const OverlayShape *sh = &ov->shapes[i];
+			if (sh->kind != SHAPE_BOUNDARY || airspace_gy(am, sh->max_lat) < yc - 1 ||
+			    airspace_gy(am, sh->min_lat) > yc + 1) {
+				continue;
+			}
+			for (int k = 0; k < sh->count; k++) {
+				int p = sh->start + k, q = ring_next(sh, k);
+				double y0 = airspace_gy(am, ov->lat[p]), y1 = airspace_gy(am, ov->lat[q]);
+				if ((y0 <= yc) != (y1 <= yc)) {
+					double x0 = airspace_gx(am, ov->lon[p]), x1 = airspace_gx(am, ov->lon[q]);
+					if (airspace_crossing(b, x0 + (yc - y0) * (x1 - x0) / (y1 - y0)) < 0) {
+						return -1;
+					}
+				}
+			}
+		}
+		qsort(b->crossings, b->crossing_count, sizeof(double), compare_double);
+		int k = 0;
+		for (int c = c0; c <= c1; c++) {
+			while (k < b->crossing_count && b->crossings[k] < c + 0.5) {
+				k++;
+			}
+			int cell = r * am->nx + c;
+			if (stamp[cell] == a) {
+				parity[cell] = k & 1;
+			} else if ((k & 1) && airspace_record(b, cell, a, -1, -1) < 0) {
+				return -1;
+			}
+		}
+	}
+	for (int i = first; i < edges_end; i++) {
+		b->records[i].entry.inside = parity[b->records[i].cell];
+	}
+	return 0;
+}
+
+// Build the mask over every area of the overlay, about one cell per two edges
+int airspace_build(AirspaceMask *am, const Overlay *ov) {
+	free_airspace_mask(am);
+	if (ov->area_count == 0) {
+		return 0;
+	}
+
+	double min_lat = ov->areas[0].min_lat, max_lat = ov->areas[0].max_lat;
+	double min_lon = ov->areas[0].min_lon, max_lon = ov->areas[0].max_lon;
+	long edges = 0;
+	for (int a = 0; a < ov->area_count; a++) {
+		const OverlayArea *area = &ov->areas[a];
+		min_lat = fmin(min_lat, area->min_lat);
+		max_lat = fmax(max_lat, area->max_lat);
+		min_lon = fmin(min_lon, area->min_lon);
+		max_lon = fmax(max_lon, area->max_lon);
+		for (int i = area->first_shape; i < area->first_shape + area->shape_count; i++) {
+			edges += ov->shapes[i].kind == SHAPE_BOUNDARY ? ov->shapes[i].count : 0;
+		}
+	}
+
+	// Square cells on the ground, the grid a hair larger than the areas
+	double cos_mid = cos((min_lat + max_lat) / 2 * M_PI / 180.0);
+	double height_nm = (max_lat - min_lat) * 60.0 + 1e-3, width_nm = (max_lon - min_lon) * 60.0 * cos_mid + 1e-3;
+	double cells = fmin(fmax(edges / (double)AIRSPACE_EDGES_PER_CELL, 1024), AIRSPACE_MAX_CELLS);
+	double cell_nm = sqrt(height_nm * width_nm / cells);
+	am->ny = (int)ceil(height_nm / cell_nm);
+	am->nx = (int)ceil(width_nm / cell_nm);
+	am->cell_lat = height_nm / 60.0 / am->ny;
+	am->cell_lon = width_nm / (60.0 * cos_mid) / am->nx;
+	am->lat0 = min_lat - am->cell_lat * 1e-6;
+	am->lon0 = min_lon - am->cell_lon * 1e-6;
+
+	size_t cell_count = (size_t)am->nx * am->ny;
+	AirspaceBuild b = {0};
+	int *stamp = malloc(cell_count * sizeof(int));
+	uint8_t *parity = calloc(cell_count, 1);
+	am->start = calloc(cell_count + 1, sizeof(int));
+	int ok = stamp && parity && am->start;
+	if (ok) {
+		for (size_t c = 0; c < cell_count; c++) {
+			stamp[c] = -1;
+		}
+	}
+	for (int a = 0; ok && a < ov->area_count; a++) {
+		ok = airspace_add_area(&b, am, ov, a, stamp, parity) == 0;
+	}
+
+	// Counting sort by cell; stable, so each area's entries stay together
+	if (ok && (am->entries = malloc((b.count ? b.count : 1) * sizeof(AirspaceEntry)))) {
+		for (int i = 0; i < b.count; i++) {
+			am->start[b.records[i].cell + 1]++;
+		}
+		for (size_t c = 0; c < cell_count; c++) {
+			am->start[c + 1] += am->start[c];
+		}
+		int *fill = stamp;
+		memcpy(fill, am->start, cell_count * sizeof(int));
+		for (int i = 0; i < b.count; i++) {
+			am->entries[fill[b.records[i].cell]++] = b.records[i].entry;
+		}
+		am->entry_count = b.count;
+	} else {
+		ok = 0;
+	}
+	free(b.records);
+	free(b.crossings);
+	free(stamp);
+	free(parity);
+	if (!ok) {
+		free_airspace_mask(am);
+		fprintf(stderr, "Failed to allocate the airspace mask\n");
+		return -1;
+	}
+	return 0;
+}
+
+static inline double orient(double ax, double ay, double bx, double by, double cx, double cy) {
+	return (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+}
+
+// Of two areas holding a point, a restricted one, then the smaller one
+static inline int airspace_better(const Overlay *ov, int a, int best) {
+	if (best < 0) {
+		return 1;
+	}
+	const OverlayArea *x = &ov->areas[a], *y = &ov->areas[best];
+	if (x->restricted != y->restricted) {
+		return x->restricted;
+	}
+	return (x->max_lat - x->min_lat) * (x->max_lon - x->min_lon) <
+	       (y->max_lat - y->min_lat) * (y->max_lon - y->min_lon);
+}
+
+// Area holding a position at an altitude, -1 when there is none
+int airspace_lookup(const AirspaceMask *am, const Overlay *ov, double lat, double lon, double altitude_ft) {
+	if (!am->start) {
+		return -1;
+	}
+	double gx = airspace_gx(am, lon), gy = airspace_gy(am, lat);
+	if (!(gx >= 0 && gy >= 0 && gx < am->nx && gy < am->ny)) {
+		return -1;
+	}
+	int cx = (int)gx, cy = (int)gy, cell = cy * am->nx + cx;
+	double xc = cx + 0.5, yc = cy + 0.5;
+	int best = -1;
+
+	for (int i = am->start[cell], end = am->start[cell + 1]; i < end;) {
+		int a = am->entries[i].area;
+		int inside = am->entries[i].inside;
+		if (am->entries[i].p < 0) {
+			inside = 1;
+			i++;
+		} else {
+			// Each local edge the line from the cell center crosses flips the answer
+			for (; i < end && am->entries[i].area == a; i++) {
+				int p = am->entries[i].p, q = am->entries[i].q;
+				double px = airspace_gx(am, ov->lon[p]), py = airspace_gy(am, ov->lat[p]);
+				double qx = airspace_gx(am, ov->lon[q]), qy = airspace_gy(am, ov->lat[q]);
+				if ((orient(xc, yc, gx, gy, px, py) > 0) != (orient(xc, yc, gx, gy, qx, qy) > 0) &&
+				    (orient(px, py, qx, qy, xc, yc) > 0) != (orient(px, py, qx, qy, gx, gy) > 0)) {
+					inside ^= 1;
+				}
+			}
+		}
+		const OverlayArea *area = &ov->areas[a];
+		if (inside && altitude_ft >= area->floor_ft && altitude_ft <= area->ceiling_ft && airspace_better(ov, a, best)) {
+			best = a;
+		}
+	}
+	return best;
+}
+
+// Reference for the benchmark: even-odd test of every ring of every area
+int airspace_lookup_slow(const Overlay *ov, double lat, double lon, double altitude_ft) {
+	int best = -1;
+	for (int a = 0; a < ov->area_count; a++) {
+		const OverlayArea *area = &ov->areas[a];
+		if (altitude_ft < area->floor_ft || altitude_ft > area->ceiling_ft) {
+			continue;
+		}
+		int inside = 0;
+		for (int i = area->first_shape; i < area->first_shape + area->shape_count; i++) {
+			const OverlayShape *sh = &ov->shapes[i];
+			if (sh->kind != SHAPE_BOUNDARY) {
+				continue;
+			}
+			for (int k = 0; k < sh->count; k++) {
+				int p = sh->start + k, q = ring_next(sh, k);
+				if ((ov->lat[p] > lat) != (ov->lat[q] > lat) &&
+				    lon < ov->lon[p] + (lat - ov->lat[p]) * (ov->lon[q] - ov->lon[p]) / (ov->lat[q] - ov->lat[p])) {
+					inside ^= 1;
+				}
+			}
+		}
+		if (inside && airspace_better(ov, a, best)) {
+			best = a;
+		}
+	}
+	return best;
+}
+
+// Frame output buffer, written to the terminal with a single write()
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t cap;
+} OutBuf;
+
+static void out_reserve(OutBuf *o, size_t extra) {
+	if (o->len + extra <= o->cap) {
+		return;
+	}
+	size_t cap = o->cap ? o->cap : 4096;
+	while (cap < o->len + extra) {
+		cap *= 2;
+	}
+	char *ptr = realloc(o->buf, cap);
+	if (!ptr) {
+		fprintf(stderr, "Not enough memory!\n");
+		exit(1);
+	}
+	o->buf = ptr;
+	o->cap = cap;
+}
+
+static void out_append(OutBuf *o, const char *s, size_t n) {
+	out_reserve(o, n);
+	memcpy(o->buf + o->len, s, n);
+	o->len += n;
+}
+
+static void out_str(OutBuf *o, const char *s) {
+	out_append(o, s, strlen(s));
+}
+
+// Append CSI <n> <final>, e.g. "\033[12C"
+static void out_csi_n(OutBuf *o, int n, char final) {
+	char tmp[16];
+	int len = snprintf(tmp, sizeof(tmp), "\033[%d%c", n, final);
+	out_append(o, tmp, len);
+}
+
+static int digits(int n) {
+	int d = 1;
+	while (n >= 10) {
+		n /= 10;
+		d++;
+	}
+	return d;
+}
+
+// Renderer state: what the terminal currently shows (shadow), which screen
+// regions changed since the last frame, the active SGR and frame byte counts
+#define SGR_UNKNOWN -1
+#define SGR_DEFAULT 0   // default foreground, otherwise a WeatherIntensity color
+
+#define SGR_GLOW 16      // SGR_GLOW + band for the afterglow
+#define SGR_OVERLAY 24
+
+// Composed cell code: an aircraft-layer or trail character, CELL_OVERLAY | glyph
+// where the overlay has one, CELL_WEATHER | intensity (with an outline glyph
+// in outline mode), or CELL_GLOW | band for a blank cell the beam passed recently
+#define CELL_BLANK ' '
+#define CELL_WEATHER 0x100
+#define CELL_GLOW 0x200
+#define CELL_OVERLAY 0x400
+#define CELL_SHADED (CELL_WEATHER | CELL_GLOW | CELL_OVERLAY)
+#define CELL_UNKNOWN 0xFFFF
+
+// Phosphor afterglow: the beam stamps every cell it passes with the sweep
+// tick, and a blank cell glows in a band given by the age of its stamp.
+// Bands are only worked out for the row spans being encoded, so the sweep
+// just marks the cells whose stamp crosses a band edge at each step.
+// Only a raster of dots glows (every 4th column of every 2nd row, square on
+// screen), which keeps the extra output to a fraction of a full-screen fill.
+#define GLOW_BANDS 3
+#define GLOW_ANCIENT 0x8000   // stamp age of cells the beam has not passed yet
+#define GLOW_DOT(x, y) ((((x) & 3) | ((y) & 1)) == 0)
+
+static const uint16_t glow_band_age[GLOW_BANDS] = {12, 36, 72};  // sweep steps, brightest band first
+
+// Layers of the picture, bottom to top. A cell shows the topmost layer
+// that is not blank there. Each layer collects its own damage, and the
+// compositor re-encodes only the union of the layers that changed, so a
+// layer that did not change costs nothing.
+typedef enum {
+	LAYER_GLOW,         // phosphor afterglow
+	LAYER_WEATHER,
+	LAYER_OVERLAY,      // airspace, runways and navaids
+	LAYER_TRAILS,
+	LAYER_AIRCRAFT,     // symbols, labels, title and panels
+	LAYER_COUNT
+} Layer;
+
+static const char *const layer_names[LAYER_COUNT] = {"glow", "weather", "overlay", "trails", "aircraft"};
+
+// Damaged cells as one span per row, x0 > x1 when the row is clean
+typedef struct {
+	int *x0;
+	int *x1;
+	int rows;               // rows with a span
+} DamageMap;
+
+typedef struct {
+	OutBuf out;
+	int fd;                 // output fd, -1 to only count bytes (headless)
+	int width;
+	int height;
+	uint16_t *shadow;       // terminal contents, width * height codes
+	DamageMap layers[LAYER_COUNT];  // changed since the last composite
+	DamageMap pending;      // composited but not yet on the terminal
+	uint64_t layer_spans[LAYER_COUNT];  // row spans each layer has damaged
+	int next_row;           // round-robin start row when the budget runs out
+	int sgr;
+	ColorDepth depth;
+	int cursor_x;           // -1 when unknown (e.g. after writing the last column)
+	int cursor_y;
+	int clear_pending;      // erase the whole screen before the next frame
+	size_t budget;          // byte limit for the next frame, 0 = unlimited
+	int budget_exhausted;   // last frame left dirty cells behind
+	int glow;               // draw the afterglow
+	uint16_t glow_tick;     // sweep tick, one per step
+	uint16_t *glow_stamp;   // tick when the beam last passed each cell, width * height
+	uint8_t *glow_band;     // scratch band row for the span being encoded
+	const uint8_t *overlay; // static overlay glyph of each cell, NULL without one
+	uint64_t frames;
+	uint64_t idle_frames;
+	uint64_t bytes;
+} Renderer;
+
+static void damage_clear(DamageMap *d, int height, int width) {
+	for (int y = 0; y < height; y++) {
+		d->x0[y] = width;
+		d->x1[y] = -1;
+	}
+	d->rows = 0;
+}
+
+static inline void damage_add(DamageMap *d, int y, int x0, int x1) {
+	if (d->x0[y] > d->x1[y]) {
+		d->x0[y] = x0;
+		d->x1[y] = x1;
+		d->rows++;
+	} else {
+		if (x0 < d->x0[y]) d->x0[y] = x0;
+		if (x1 > d->x1[y]) d->x1[y] = x1;
+	}
+}
+
+static int damage_resize(DamageMap *d, int height) {
+	int *x0 = realloc(d->x0, height * sizeof(int));
+	if (x0) d->x0 = x0;
+	int *x1 = realloc(d->x1, height * sizeof(int));
+	if (x1) d->x1 = x1;
+	return x0 && x1 ? 0 : -1;
+}
+
+static void mark_all_dirty(Renderer *r) {
+	for (int y = 0; y < r->height; y++) {
+		r->pending.x0[y] = 0;
+		r->pending.x1[y] = r->width - 1;
+	}
+	r->pending.rows = r->height;
+	for (int l = 0; l < LAYER_COUNT; l++) {
+		damage_clear(&r->layers[l], r->height, r->width);
+	}
+}
+
+// (Re)allocate the shadow and damage maps; the next frame is a full redraw
+int renderer_resize(Renderer *r, int height, int width) {
+	uint16_t *shadow = realloc(r->shadow, (size_t)width * height * sizeof(uint16_t));
+	uint16_t *stamp = realloc(r->glow_stamp, (size_t)width * height * sizeof(uint16_t));
+	uint8_t *band = realloc(r->glow_band, width);
+	int damage_ok = damage_resize(&r->pending, height) == 0;
+	for (int l = 0; l < LAYER_COUNT; l++) {
+		damage_ok &= damage_resize(&r->layers[l], height) == 0;
+	}
+
+	if (shadow) r->shadow = shadow;
+	if (stamp) r->glow_stamp = stamp;
+	if (band) r->glow_band = band;
+	if (!shadow || !stamp || !band || !damage_ok) {
+		return -1;
+	}
+
+	r->width = width;
+	r->height = height;
+	// Nothing glows until the beam has passed over the new screen
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		r->glow_stamp[i] = (uint16_t)(r->glow_tick - GLOW_ANCIENT);
+	}
+	r->next_row = 0;
+	r->clear_pending = 1;
+	mark_all_dirty(r);
+	return 0;
+}
+
+void free_renderer(Renderer *r) {
+	free(r->out.buf);
+	free(r->shadow);
+	free(r->pending.x0);
+	free(r->pending.x1);
+	for (int l = 0; l < LAYER_COUNT; l++) {
+		free(r->layers[l].x0);
+		free(r->layers[l].x1);
+	}
+	free(r->glow_stamp);
+	free(r->glow_band);
+}
+
+// Mark one cell of a layer as changed since the last frame
+static inline void mark_dirty(Renderer *r, Layer layer, int y, int x) {
+	damage_add(&r->layers[layer], y, x, x);
+}
+
+// Fold the damage of every changed layer into what the next frame encodes
+static void composite_damage(Renderer *r) {
+	for (int l = 0; l < LAYER_COUNT; l++) {
+		DamageMap *d = &r->layers[l];
+		if (d->rows == 0) {
+			continue;
+		}
+		r->layer_spans[l] += d->rows;
+		for (int y = 0; y < r->height; y++) {
+			if (d->x0[y] <= d->x1[y]) {
+				damage_add(&r->pending, y, d->x0[y], d->x1[y]);
+				d->x0[y] = r->width;
+				d->x1[y] = -1;
+			}
+		}
+		d->rows = 0;
+	}
+}
+
+// Change the weather color depth; weather and afterglow already on the terminal are re-sent
+void renderer_set_depth(Renderer *r, ColorDepth depth) {
+	if (r->depth == depth) {
+		return;
+	}
+	r->depth = depth;
+	for (int y = 0; y < r->height; y++) {
+		uint16_t *row = r->shadow + (size_t)y * r->width;
+		for (int x = 0; x < r->width; x++) {
+			if (row[x] != CELL_UNKNOWN && (row[x] & CELL_SHADED)) {
+				row[x] = CELL_UNKNOWN;
+				damage_add(&r->pending, y, x, x);
+			}
+		}
+	}
+}
+
+// Cell code of one layer, CELL_BLANK where it has nothing; the afterglow
+// is only known for the row glow_bands() last worked out
+static inline uint16_t layer_code(const Renderer *r, const Matrix *m, Layer layer, int y, int x) {
+	switch (layer) {
+		case LAYER_GLOW:
+			return r->glow_band[x] ? CELL_GLOW | r->glow_band[x] : CELL_BLANK;
+		case LAYER_WEATHER:
+			return m->weather[y][x] != WEATHER_NONE ? CELL_WEATHER | m->weather[y][x] : CELL_BLANK;
+		case LAYER_OVERLAY:
+			return r->overlay && r->overlay[(size_t)y * r->width + x] ?
+			       CELL_OVERLAY | r->overlay[(size_t)y * r->width + x] : CELL_BLANK;
+		case LAYER_TRAILS:
+			return (unsigned char)m->trail[y][x];
+		default:
+			return (unsigned char)m->data[y][x];
+	}
+}
+
+// Topmost non-blank cell of the layers from bottom up; written out layer by
+// layer so each call site compiles to a plain chain of tests
+static inline uint16_t compose_cell(const Renderer *r, const Matrix *m, int y, int x, Layer bottom) {
+	uint16_t code;
+	if ((code = layer_code(r, m, LAYER_AIRCRAFT, y, x)) != CELL_BLANK) return code;
+	if (bottom <= LAYER_TRAILS && (code = layer_code(r, m, LAYER_TRAILS, y, x)) != CELL_BLANK) return code;
+	if (bottom <= LAYER_OVERLAY && (code = layer_code(r, m, LAYER_OVERLAY, y, x)) != CELL_BLANK) return code;
+	if (bottom <= LAYER_WEATHER && (code = layer_code(r, m, LAYER_WEATHER, y, x)) != CELL_BLANK) return code;
+	if (bottom <= LAYER_GLOW && (code = layer_code(r, m, LAYER_GLOW, y, x)) != CELL_BLANK) return code;
+	return CELL_BLANK;
+}
+
+// Afterglow band of each cell of row y from x0 to the end of the row, into
+// r->glow_band; 0 where there is none, and a single band in 16 colors
+static void glow_bands(Renderer *r, int y, int x0) {
+	const uint16_t *stamp = r->glow_stamp + (size_t)y * r->width;
+	uint8_t *band = r->glow_band;
+	int x = x0;
+
+	if (!r->glow || r->depth == DEPTH_MONO || (y & 1)) {
+		memset(band + x0, 0, r->width - x0);
+		return;
+	}
+	uint8_t max_band = r->depth == DEPTH_16 ? 1 : GLOW_BANDS;
+
+#ifdef __SSE2__
+	// The age wraps like the tick; age < limit exactly when the saturating
+	// limit - age is nonzero, so each band edge costs one compare per 8 cells
+	static const uint8_t dots[16 + 3] = {
+		0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0
+	};
+	const __m128i tick = _mm_set1_epi16((short)r->glow_tick);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i cap = _mm_set1_epi8((char)max_band);
+	const __m128i dot_mask = _mm_loadu_si128((const __m128i *)(dots + (x0 & 3)));
+	__m128i limit[GLOW_BANDS];
+	for (int b = 0; b < GLOW_BANDS; b++) {
+		limit[b] = _mm_set1_epi16((short)glow_band_age[b]);
+	}
+	for (; x + 16 <= r->width; x += 16) {
+		__m128i age_lo = _mm_sub_epi16(tick, _mm_loadu_si128((const __m128i *)(stamp + x)));
+		__m128i age_hi = _mm_sub_epi16(tick, _mm_loadu_si128((const __m128i *)(stamp + x + 8)));
+		__m128i lo = _mm_set1_epi16(GLOW_BANDS);
+		__m128i hi = lo;
+		for (int b = 0; b < GLOW_BANDS; b++) {
+			// All ones (-1) for every edge the cell is past
+			lo = _mm_add_epi16(lo, _mm_cmpeq_epi16(_mm_subs_epu16(limit[b], age_lo), zero));
+			hi = _mm_add_epi16(hi, _mm_cmpeq_epi16(_mm_subs_epu16(limit[b], age_hi), zero));
+		}
+		__m128i b = _mm_min_epu8(_mm_packus_epi16(lo, hi), cap);
+		_mm_storeu_si128((__m128i *)(band + x), _mm_and_si128(b, dot_mask));
+	}
+#endif
+	for (; x < r->width; x++) {
+		uint16_t age = r->glow_tick - stamp[x];
+		uint8_t b = 0;
+		for (int i = 0; i < GLOW_BANDS; i++) {
+			b += age < glow_band_age[i];
+		}
+		band[x] = !GLOW_DOT(x, y) ? 0 : b < max_band ? b : max_band;
+	}
+}
+
+// Cell code of the whole stack, with the afterglow band worked out by glow_bands()
+static inline uint16_t render_code(const Renderer *r, const Matrix *m, int y, int x) {
+	return compose_cell(r, m, y, x, LAYER_GLOW);
+}
+
+// Aircraft-layer cells (symbols, labels, title) go out before weather shading
+static inline int code_is_priority(uint16_t code) {
+	return code != CELL_BLANK && !(code & CELL_SHADED);
+}
+
+static inline int code_color(const Renderer *r, uint16_t code) {
+	if (r->depth == DEPTH_MONO) {
+		return SGR_DEFAULT;
+	}
+	if (code & CELL_GLOW) {
+		return SGR_GLOW + (code & 0xFF);
+	}
+	if (code & CELL_OVERLAY) {
+		return SGR_OVERLAY;
+	}
+	if (code & CELL_WEATHER) {
+		return OUTLINE_BAND(code & 0xFF);
+	}
+	return SGR_DEFAULT;
+}
+
+// Glyph of a weather, outline or afterglow cell (UTF-8 except in monochrome)
+static inline const char *code_shade_char(const Renderer *r, uint16_t code) {
+	if (code & CELL_GLOW) {
+		return r->depth == DEPTH_256 ? "·" : ".";
+	}
+	if (code & CELL_OVERLAY) {
+		return r->depth == DEPTH_MONO ? overlay_chars_ascii[code & 0xFF] : overlay_chars[code & 0xFF];
+	}
+	int glyph = OUTLINE_GLYPH(code & 0xFF);
+	if (glyph) {
+		return r->depth == DEPTH_MONO ? outline_chars_ascii[glyph] : outline_chars[glyph];
+	}
+	return r->depth == DEPTH_MONO ? get_weather_char_ascii((WeatherIntensity)(code & 0xFF))
+	                              : get_weather_char((WeatherIntensity)(code & 0xFF));
+}
+
+// Cell that can be rewritten as one byte without a color change
+static inline int code_is_cheap(const Renderer *r, uint16_t code) {
+	if (code == CELL_BLANK) {
+		return 1;
+	}
+	if (code == CELL_UNKNOWN || code_color(r, code) != r->sgr) {
+		return 0;
+	}
+	return !(code & CELL_SHADED) || code_shade_char(r, code)[1] == '\0';
+}
+
+// Switch the foreground color only when it differs from what the terminal has
+static void render_set_color(Renderer *r, int color) {
+	static const char *const glow_colors[GLOW_BANDS + 1] = {"", COLOR_GLOW1, COLOR_GLOW2, COLOR_GLOW3};
+
+	if (r->sgr == color) {
+		return;
+	}
+	if (color == SGR_DEFAULT) {
+		out_str(&r->out, "\033[m");  // shortest reset, only the foreground is ever set
+	} else if (color == SGR_OVERLAY) {
+		out_str(&r->out, r->depth == DEPTH_16 ? COLOR16_OVERLAY : COLOR_OVERLAY);
+	} else if (color >= SGR_GLOW) {
+		out_str(&r->out, r->depth == DEPTH_16 ? COLOR16_GREEN : glow_colors[color - SGR_GLOW]);
+	} else if (r->depth == DEPTH_16) {
+		out_str(&r->out, get_weather_color16((WeatherIntensity)color));
+	} else {
+		out_str(&r->out, get_weather_color((WeatherIntensity)color));
+	}
+	r->sgr = color;
+}
+
+static void render_glyph(Renderer *r, uint16_t code) {
+	if (code & CELL_SHADED) {
+		out_str(&r->out, code_shade_char(r, code));
+	} else {
+		char ch = (char)code;
+		out_append(&r->out, &ch, 1);
+	}
+}
+
+// Move the cursor with the cheapest sequence: nothing, CR+LF, forward, or absolute
+static void render_move(Renderer *r, int y, int x) {
+	if (r->cursor_y == y && r->cursor_x == x) {
+		return;
+	}
+
+	if (r->cursor_y == y && r->cursor_x >= 0 && x > r->cursor_x) {
+		int gap = x - r->cursor_x;
+		// Rewriting a short gap of unchanged single-byte cells beats "\033[nC"
+		if (gap < 3 + digits(gap)) {
+			const uint16_t *row = r->shadow + (size_t)y * r->width;
+			int ok = 1;
+			for (int i = r->cursor_x; i < x && ok; i++) {
+				ok = code_is_cheap(r, row[i]);
+			}
+			if (ok) {
+				for (int i = r->cursor_x; i < x; i++) {
+					render_glyph(r, row[i]);
+				}
+				r->cursor_x = x;
+				return;
+			}
+		}
+		out_csi_n(&r->out, gap, 'C');
+	} else if (x == 0 && r->cursor_y >= 0 && y == r->cursor_y + 1) {
+		out_str(&r->out, "\r\n");
+	} else if (x == 0) {
+		out_csi_n(&r->out, y + 1, 'H');
+	} else {
+		char tmp[32];
+		int len = snprintf(tmp, sizeof(tmp), "\033[%d;%dH", y + 1, x + 1);
+		out_append(&r->out, tmp, len);
+	}
+	r->cursor_y = y;
+	r->cursor_x = x;
+}
+
+static inline int over_budget(Renderer *r) {
+	if (r->budget && r->out.len >= r->budget) {
+		r->budget_exhausted = 1;
+		return 1;
+	}
+	return 0;
+}
+
+// Emit only the aircraft-layer changes of a row span; weather is left dirty
+static void render_row_priority(Renderer *r, const Matrix *m, int y, int x0, int x1) {
+	uint16_t *row = r->shadow + (size_t)y * r->width;
+
+	for (int x = x0; x <= x1 && !over_budget(r); x++) {
+		uint16_t code = compose_cell(r, m, y, x, LAYER_TRAILS);
+		if (code == row[x] || (!code_is_priority(code) && !code_is_priority(row[x]))) {
+			continue;
+		}
+		render_move(r, y, x);
+		if (code_is_priority(code)) {
+			render_set_color(r, SGR_DEFAULT);
+			render_glyph(r, code);
+		} else {
+			out_str(&r->out, " ");  // erase a label character, weather follows later
+			code = CELL_BLANK;
+		}
+		row[x] = code;
+		r->cursor_x = (x + 1 < r->width) ? x + 1 : -1;
+	}
+}
+
+// Emit the changed cells of one dirty row span, updating the shadow;
+// returns the first column not handled (x1 + 1 when the span is done)
+static int render_row_span(Renderer *r, const Matrix *m, int y, int x0, int x1) {
+	uint16_t *row = r->shadow + (size_t)y * r->width;
+	glow_bands(r, y, x0);
+
+	// Past this column the row is blank, so one erase-to-end-of-line clears it
+	int last = m->width - 1;
+	while (last >= x0 && render_code(r, m, y, last) == CELL_BLANK) {
+		last--;
+	}
+
+	int x = x0;
+	while (x <= x1) {
+		uint16_t code = render_code(r, m, y, x);
+		if (code == row[x]) {
+			x++;
+			continue;
+		}
+		if (over_budget(r)) {
+			return x;
+		}
+
+		render_move(r, y, x);
+
+		if (code == CELL_BLANK) {
+			if (x > last) {
+				out_str(&r->out, "\033[K");
+				for (int i = x; i < m->width; i++) {
+					row[i] = CELL_BLANK;
+				}
+				return x1 + 1;
+			}
+
+			// Run of cells that must become blank: spaces, or erase + skip
+			int run = 1;
+			while (x + run <= x1 && row[x + run] != CELL_BLANK && render_code(r, m, y, x + run) == CELL_BLANK) {
+				run++;
+			}
+			if (run <= 3 + digits(run)) {
+				out_reserve(&r->out, run);
+				memset(r->out.buf + r->out.len, ' ', run);
+				r->out.len += run;
+				r->cursor_x = x + run;
+			} else {
+				out_csi_n(&r->out, run, 'X');  // erase leaves the cursor in place
+			}
+			for (int i = x; i < x + run; i++) {
+				row[i] = CELL_BLANK;
+			}
+			x += run;
+			continue;
+		}
+
+		render_set_color(r, code_color(r, code));
+		render_glyph(r, code);
+		row[x] = code;
+		x++;
+		// Writing the last column leaves the cursor in the pending-wrap state
+		r->cursor_x = (x < r->width) ? x : -1;
+	}
+	return x1 + 1;
+}
+
+// Write the frame buffer out, retrying on short writes
+static void render_flush(Renderer *r) {
+	size_t off = 0;
+	while (r->fd >= 0 && off < r->out.len) {
+		ssize_t n = write(r->fd, r->out.buf + off, r->out.len - off);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		off += n;
+	}
+	r->bytes += r->out.len;
+	r->out.len = 0;
+}
+
+// Encode only the dirty regions of the revealed screen into the frame buffer;
+// returns 0 when nothing visible changed. With a byte budget, aircraft-layer
+// changes go first and whatever does not fit stays dirty for the next frame.
+int render_frame(Renderer *r, const Matrix *screen) {
+	r->budget_exhausted = 0;
+	composite_damage(r);
+
+	if (r->clear_pending) {
+		out_str(&r->out, "\033[m\033[2J");
+		r->sgr = SGR_DEFAULT;
+		r->cursor_x = r->cursor_y = -1;
+		for (size_t i = 0; i < (size_t)r->width * r->height; i++) {
+			r->shadow[i] = CELL_BLANK;
+		}
+		mark_all_dirty(r);
+		r->clear_pending = 0;
+	}
+
+	DamageMap *d = &r->pending;
+	if (d->rows == 0) {
+		return 0;
+	}
+
+	if (r->budget) {
+		for (int y = 0; y < r->height && !r->budget_exhausted; y++) {
+			if (d->x0[y] <= d->x1[y]) {
+				render_row_priority(r, screen, y, d->x0[y], d->x1[y]);
+			}
+		}
+	}
+
+	for (int i = 0; i < r->height && !r->budget_exhausted; i++) {
+		int y = (r->next_row + i) % r->height;
+		if (d->x0[y] > d->x1[y]) {
+			continue;
+		}
+
+		int done = render_row_span(r, screen, y, d->x0[y], d->x1[y]);
+		if (done <= d->x1[y]) {
+			// Out of budget: the rest of this row is where the next frame starts
+			d->x0[y] = done;
+			r->next_row = y;
+			break;
+		}
+		d->x0[y] = r->width;
+		d->x1[y] = -1;
+		d->rows--;
+	}
+	return 1;
+}
+
+void render_screen(Renderer *r, const Matrix *screen) {
+	if (render_frame(r, screen) && r->out.len > 0) {
+		render_flush(r);
+		r->frames++;
+	} else {
+		r->out.len = 0;
+		r->idle_frames++;
+	}
+}
+
+// Bandwidth cap for slow remote consoles: a token bucket decides when a frame
+// may go out and how many bytes it may use; sustained saturation lowers the
+// weather color depth, sustained headroom raises it again
+#define BANDWIDTH_BURST_S 0.25      // bucket depth in seconds of rate
+#define BANDWIDTH_MIN_CHUNK 256     // don't bother with frames smaller than this
+#define BANDWIDTH_ADJUST_S 5        // color depth re-evaluation period
+
+typedef struct {
+	double rate;            // bytes per second, 0 = unlimited
+	double tokens;
+	struct timespec last_refill;
+	struct timespec last_adjust;
+	int window_frames;
+	int window_saturated;
+	uint64_t deferred_frames;
+	int depth_changes;
+} BandwidthLimit;
+
+// Returns the byte budget for this frame, or 0 when the frame must be deferred
+size_t bandwidth_frame_budget(BandwidthLimit *bw) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	double dt = (now.tv_sec - bw->last_refill.tv_sec) + (now.tv_nsec - bw->last_refill.tv_nsec) / 1e9;
+	bw->last_refill = now;
+	bw->tokens += dt * bw->rate;
+	if (bw->tokens > bw->rate * BANDWIDTH_BURST_S + BANDWIDTH_MIN_CHUNK) {
+		bw->tokens = bw->rate * BANDWIDTH_BURST_S + BANDWIDTH_MIN_CHUNK;
+	}
+
+	if (bw->tokens < BANDWIDTH_MIN_CHUNK) {
+		bw->deferred_frames++;
+		return 0;
+	}
+	return (size_t)bw->tokens;
+}
+
+// Charge a rendered frame and adapt the color depth to the observed demand
+void bandwidth_account(BandwidthLimit *bw, Renderer *r, size_t bytes) {
+	bw->tokens -= bytes;
+	bw->window_frames++;
+	if (r->budget_exhausted) {
+		bw->window_saturated++;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec - bw->last_adjust.tv_sec < BANDWIDTH_ADJUST_S) {
+		return;
+	}
+
+	ColorDepth depth = r->depth;
+	if (bw->window_saturated * 2 > bw->window_frames && depth < DEPTH_MONO) {
+		depth++;
+	} else if (bw->window_saturated * 10 < bw->window_frames && depth > DEPTH_256) {
+		depth--;
+	}
+	if (depth != r->depth) {
+		renderer_set_depth(r, depth);
+		bw->depth_changes++;
+	}
+
+	bw->last_adjust = now;
+	bw->window_frames = 0;
+	bw->window_saturated = 0;
+}
+
+// Milliseconds of CLOCK_MONOTONIC since start
+static double elapsed_ms(const struct timespec *start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Append-only history of every accepted state, stored as hourly segment files
+// of column blocks. Each block holds up to HISTORY_BLOCK_RECORDS records; each
+// column is delta-coded against the previous record and written as zigzag
+// varints. The block header carries the time range so scans can skip blocks.
+//
+// Segment file: HistoryFileHeader, then HistoryBlockHeader + column bytes, ...
+#define HISTORY_MAGIC "ADSBHIST"
+#define HISTORY_VERSION 1
+#define HISTORY_BLOCK_MAGIC 0x4B4C4248u   // "HBLK"
+#define HISTORY_COLUMNS 7
+#define HISTORY_BLOCK_RECORDS 4096
+#define HISTORY_FLUSH_S 10                // max age of a partial block
+#define HISTORY_QUEUE_MAX (1 << 20)       // records waiting for the writer
+
+// Fixed-point state as stored on disk
+typedef struct {
+	int64_t time;       // unix seconds
+	int64_t icao24;
+	int64_t lat;        // 1e-5 degrees
+	int64_t lon;        // 1e-5 degrees
+	int64_t altitude;   // decimetres
+	int64_t velocity;   // cm/s
+	int64_t track;      // 0.01 degrees, -1 when unknown
+} HistoryRecord;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t columns;
+	int64_t hour_start;     // unix seconds of the hour this segment covers
+} HistoryFileHeader;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+	int64_t t_min;
+	int64_t t_max;
+	uint32_t column_bytes[HISTORY_COLUMNS];
+	uint32_t reserved;
+} HistoryBlockHeader;
+
+typedef struct {
+	char dir[PATH_MAX];
+	pthread_t thread;
+	int started;
+
+	// Shared with the writer thread
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	HistoryRecord *pending;
+	size_t pending_count;
+	size_t pending_cap;
+	int stop;
+	uint64_t dropped;       // records lost: queue full or a failed write
+
+	// Writer thread only
+	HistoryRecord *batch;
+	size_t batch_cap;
+	uint8_t *encoded;
+	size_t encoded_cap;
+	int fd;
+	int64_t segment_hour;
+	uint64_t written;
+	uint64_t bytes;
+} HistoryStore;
+
+static inline int64_t history_column(const HistoryRecord *rec, int column) {
+	switch (column) {
+		case 0: return rec->time;
+		case 1: return rec->icao24;
+		case 2: return rec->lat;
+		case 3: return rec->lon;
+		case 4: return rec->altitude;
+		case 5: return rec->velocity;
+		default: return rec->track;
+	}
+}
+
+static inline size_t put_varint(uint8_t *out, uint64_t v) {
+	size_t n = 0;
+	while (v >= 0x80) {
+		out[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	out[n++] = (uint8_t)v;
+	return n;
+}
+
+static inline uint64_t zigzag(int64_t v) {
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+// Convert a decoded aircraft into its on-disk fixed-point form
+void history_record_from_aircraft(HistoryRecord *rec, const Aircraft *ac) {
+	rec->time = ac->timestamp;
+	rec->icao24 = ac->icao24;
+	rec->lat = llround(ac->latitude * 1e5);
+	rec->lon = llround(ac->longitude * 1e5);
+	rec->altitude = llround(ac->altitude * 10.0);
+	rec->velocity = llround(ac->velocity * 100.0);
+	rec->track = ac->track >= 0 ? llround(ac->track * 100.0) : -1;
+}
+
+// Records the writer could not store count as dropped, like a full queue
+static void history_drop(HistoryStore *hs, size_t count) {
+	pthread_mutex_lock(&hs->lock);
+	hs->dropped += count;
+	pthread_mutex_unlock(&hs->lock);
+}
+
+// Length of the intact part of an existing segment: the file header and
+// every complete block after it, so a block torn by a crash or a failed
+// write can be cut off before appending; -1 when it is no segment of ours
+static off_t history_intact_length(int fd, off_t size) {
+	HistoryFileHeader fh;
+	if (size < (off_t)sizeof(fh)) {
+		return 0;       // torn file header, start over
+	}
+	if (pread(fd, &fh, sizeof(fh), 0) != sizeof(fh) ||
+	    memcmp(fh.magic, HISTORY_MAGIC, sizeof(fh.magic)) != 0 ||
+	    fh.version != HISTORY_VERSION || fh.columns != HISTORY_COLUMNS) {
+		return -1;
+	}
+
+	off_t off = sizeof(fh);
+	HistoryBlockHeader bh;
+	while (off + (off_t)sizeof(bh) <= size &&
+	       pread(fd, &bh, sizeof(bh), off) == sizeof(bh) &&
+	       bh.magic == HISTORY_BLOCK_MAGIC && bh.count > 0) {
+		off_t len = sizeof(bh);
+		for (int c = 0; c < HISTORY_COLUMNS; c++) {
+			len += bh.column_bytes[c];
+		}
+		if (off + len > size) {
+			break;
+		}
+		off += len;
+	}
+	return off;
+}
+
+// Open (or continue) the segment for the hour starting at hour_start
+static int history_open_segment(HistoryStore *hs, int64_t hour_start) {
+	if (hs->fd >= 0) {
+		close(hs->fd);
+		hs->fd = -1;
+	}
+
+	time_t t = (time_t)hour_start;
+	struct tm tm;
+	gmtime_r(&t, &tm);
+
+	char path[PATH_MAX + 64];
+	snprintf(path, sizeof(path), "%s/%04d%02d%02d-%02d.adsb", hs->dir,
+	         tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour);
+
+	hs->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (hs->fd < 0) {
+		fprintf(stderr, "history: cannot open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct stat sb;
+	if (fstat(hs->fd, &sb) < 0) {
+		close(hs->fd);
+		hs->fd = -1;
+		return -1;
+	}
+	if (sb.st_size > 0) {
+		off_t intact = history_intact_length(hs->fd, sb.st_size);
+		if (intact < 0) {
+			fprintf(stderr, "history: %s is not a history segment, not appending\n", path);
+			close(hs->fd);
+			hs->fd = -1;
+			return -1;
+		}
+		if (intact < sb.st_size) {
+			fprintf(stderr, "history: %s: cutting %lld bytes of a torn block\n",
+			        path, (long long)(sb.st_size - intact));
+			if (ftruncate(hs->fd, intact) < 0) {
+				fprintf(stderr, "history: cannot repair %s: %s\n", path, strerror(errno));
+				close(hs->fd);
+				hs->fd = -1;
+				return -1;
+			}
+			sb.st_size = intact;
+		}
+	}
+	if (sb.st_size == 0) {
+		HistoryFileHeader fh;
+		memset(&fh, 0, sizeof(fh));
+		memcpy(fh.magic, HISTORY_MAGIC, sizeof(fh.magic));
+		fh.version = HISTORY_VERSION;
+		fh.columns = HISTORY_COLUMNS;
+		fh.hour_start = hour_start;
+		if (write(hs->fd, &fh, sizeof(fh)) != sizeof(fh)) {
+			// A torn file header is started over when the file is reopened
+			fprintf(stderr, "history: cannot write %s: %s\n", path, strerror(errno));
+			close(hs->fd);
+			hs->fd = -1;
+			return -1;
+		}
+	}
+	hs->segment_hour = hour_start;
+	return 0;
+}
+
+// Encode and append one block of records that all fall into the same hour
+static void history_write_block(HistoryStore *hs, const HistoryRecord *recs, size_t count) {
+	int64_t hour = recs[0].time - (recs[0].time % 3600);
+	if (hs->fd < 0 || hour != hs->segment_hour) {
+		if (history_open_segment(hs, hour) < 0) {
+			history_drop(hs, count);
+			return;
+		}
+	}
+
+	// Worst case 10 bytes per varint
+	size_t need = sizeof(HistoryBlockHeader) + count * HISTORY_COLUMNS * 10;
+	if (need > hs->encoded_cap) {
+		uint8_t *ptr = realloc(hs->encoded, need);
+		if (!ptr) {
+			history_drop(hs, count);
+			return;
+		}
+		hs->encoded = ptr;
+		hs->encoded_cap = need;
+	}
+
+	HistoryBlockHeader *bh = (HistoryBlockHeader *)hs->encoded;
+	memset(bh, 0, sizeof(*bh));
+	bh->magic = HISTORY_BLOCK_MAGIC;
+	bh->count = count;
+	bh->t_min = bh->t_max = recs[0].time;
+
+	size_t len = sizeof(*bh);
+	for (int c = 0; c < HISTORY_COLUMNS; c++) {
+		size_t start = len;
+		int64_t prev = 0;
+		for (size_t i = 0; i < count; i++) {
+			int64_t v = history_column(&recs[i], c);
+			len += put_varint(hs->encoded + len, zigzag(v - prev));
+			prev = v;
+		}
+		bh->column_bytes[c] = len - start;
+	}
+	for (size_t i = 1; i < count; i++) {
+		if (recs[i].time < bh->t_min) bh->t_min = recs[i].time;
+		if (recs[i].time > bh->t_max) bh->t_max = recs[i].time;
+	}
+
+	// A write failing partway (e.g. ENOSPC) is cut back to the last whole block
+	off_t end = lseek(hs->fd, 0, SEEK_END);
+	size_t off = 0;
+	while (off < len) {
+		ssize_t n = write(hs->fd, hs->encoded + off, len - off);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			fprintf(stderr, "history: write failed: %s\n", strerror(errno));
+			if (off > 0 && (end < 0 || ftruncate(hs->fd, end) < 0)) {
+				// Could not cut it: leave the segment to be repaired when reopened
+				close(hs->fd);
+				hs->fd = -1;
+			}
+			history_drop(hs, count);
+			return;
+		}
+		off += n;
+	}
+	hs->written += count;
+	hs->bytes += len;
+}
+
+// Split a batch at hour boundaries and block size, and write it out
+static void history_write_batch(HistoryStore *hs, const HistoryRecord *recs, size_t count) {
+	size_t start = 0;
+	while (start < count) {
+		int64_t hour = recs[start].time - (recs[start].time % 3600);
+		size_t end = start + 1;
+		while (end < count && end - start < HISTORY_BLOCK_RECORDS &&
+		       recs[end].time - (recs[end].time % 3600) == hour) {
+			end++;
+		}
+		history_write_block(hs, recs + start, end - start);
+		start = end;
+	}
+}
+
+// Writer thread: collects records until a block is full or HISTORY_FLUSH_S passed
+static void *history_writer_main(void *arg) {
+	HistoryStore *hs = (HistoryStore *)arg;
+	time_t last_flush = time(NULL);
+
+	pthread_mutex_lock(&hs->lock);
+	for (;;) {
+		while (!hs->stop && hs->pending_count < HISTORY_BLOCK_RECORDS &&
+		       time(NULL) - last_flush < HISTORY_FLUSH_S) {
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += 1;
+			pthread_cond_timedwait(&hs->wake, &hs->lock, &deadline);
+		}
+
+		// Swap buffers so the event loop can keep appending while we encode
+		HistoryRecord *recs = hs->pending;
+		size_t count = hs->pending_count;
+		size_t cap = hs->pending_cap;
+		hs->pending = hs->batch;
+		hs->pending_cap = hs->batch_cap;
+		hs->pending_count = 0;
+		hs->batch = recs;
+		hs->batch_cap = cap;
+		int stop = hs->stop;
+		pthread_mutex_unlock(&hs->lock);
+
+		if (count > 0) {
+			history_write_batch(hs, recs, count);
+		}
+		last_flush = time(NULL);
+
+		pthread_mutex_lock(&hs->lock);
+		if (stop) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&hs->lock);
+
+	if (hs->fd >= 0) {
+		close(hs->fd);
+		hs->fd = -1;
+	}
+	return NULL;
+}
+
+int history_start(HistoryStore *hs, const char *dir) {
+	memset(hs, 0, sizeof(*hs));
+	hs->fd = -1;
+	snprintf(hs->dir, sizeof(hs->dir), "%s", dir);
+
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		fprintf(stderr, "history: cannot create %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	pthread_mutex_init(&hs->lock, NULL);
+	pthread_cond_init(&hs->wake, NULL);
+	if (pthread_create(&hs->thread, NULL, history_writer_main, hs) != 0) {
+		fprintf(stderr, "history: cannot start writer thread\n");
+		return -1;
+	}
+	hs->started = 1;
+	return 0;
+}
+
+// Queue accepted states for the writer; never waits on disk
+void history_append(HistoryStore *hs, const Aircraft *aircraft, int count) {
+	if (!hs->started || count <= 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&hs->lock);
+	if (hs->pending_count + count > HISTORY_QUEUE_MAX) {
+		hs->dropped += count;
+		pthread_mutex_unlock(&hs->lock);
+		return;
+	}
+	if (hs->pending_count + count > hs->pending_cap) {
+		size_t cap = hs->pending_cap ? hs->pending_cap : HISTORY_BLOCK_RECORDS;
+		while (cap < hs->pending_count + count) {
+			cap *= 2;
+		}
+		HistoryRecord *ptr = realloc(hs->pending, cap * sizeof(HistoryRecord));
+		if (!ptr) {
+			hs->dropped += count;
+			pthread_mutex_unlock(&hs->lock);
+			return;
+		}
+		hs->pending = ptr;
+		hs->pending_cap = cap;
+	}
+	for (int i = 0; i < count; i++) {
+		history_record_from_aircraft(&hs->pending[hs->pending_count++], &aircraft[i]);
+	}
+	if (hs->pending_count >= HISTORY_BLOCK_RECORDS) {
+		pthread_cond_signal(&hs->wake);
+	}
+	pthread_mutex_unlock(&hs->lock);
+}
+
+// Flush what is queued and stop the writer
+void history_stop(HistoryStore *hs) {
+	if (!hs->started) {
+		return;
+	}
+	pthread_mutex_lock(&hs->lock);
+	hs->stop = 1;
+	pthread_cond_signal(&hs->wake);
+	pthread_mutex_unlock(&hs->lock);
+	pthread_join(hs->thread, NULL);
+
+	pthread_mutex_destroy(&hs->lock);
+	pthread_cond_destroy(&hs->wake);
+	free(hs->pending);
+	free(hs->batch);
+	free(hs->encoded);
+	hs->started = 0;
+}
+
+// Replay of recorded history: every segment file is mmapped and its block
+// headers form a sparse time index. The picture at replay time T is the
+// latest state per aircraft within REPLAY_WINDOW_S before T, so any speed
+// only decodes the few blocks around T and skips everything in between.
+#define REPLAY_WINDOW_S 60       // states older than this are dropped
+#define REPLAY_TICK_MS 200       // picture update period (wall clock)
+#define REPLAY_MAX_SPEED 1000.0
+
+typedef struct {
+	const uint8_t *base;
+	size_t size;
+} ReplaySegment;
+
+typedef struct {
+	int64_t t_min;
+	int64_t t_max_running;   // max t_max of this and all earlier blocks
+	uint32_t segment;
+	uint32_t count;
+	size_t offset;           // of the HistoryBlockHeader
+} ReplayBlock;
+
+typedef struct {
+	ReplaySegment *segments;
+	int segment_count;
+	ReplayBlock *blocks;
+	size_t block_count;
+	int64_t first_time;
+	int64_t last_time;
+
+	// Replay clock: replay time = anchor_time + (wall - anchor_wall) * speed
+	double anchor_time;
+	struct timespec anchor_wall;
+	double speed;
+	int paused;
+
+	uint64_t updates;
+	uint64_t blocks_decoded;
+} Replay;
+
+static int compare_names(const void *a, const void *b) {
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+// Map one segment and append its block headers to the index
+static int replay_index_segment(Replay *rp, const char *path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(HistoryFileHeader)) {
+		close(fd);
+		return -1;
+	}
+	const uint8_t *base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+	const HistoryFileHeader *fh = (const HistoryFileHeader *)base;
+	if (memcmp(fh->magic, HISTORY_MAGIC, sizeof(fh->magic)) != 0 ||
+	    fh->version != HISTORY_VERSION || fh->columns != HISTORY_COLUMNS) {
+		fprintf(stderr, "replay: %s is not a history segment\n", path);
+		munmap((void *)base, sb.st_size);
+		return -1;
+	}
+
+	ReplaySegment *segs = realloc(rp->segments, (rp->segment_count + 1) * sizeof(ReplaySegment));
+	if (!segs) {
+		munmap((void *)base, sb.st_size);
+		return -1;
+	}
+	rp->segments = segs;
+	rp->segments[rp->segment_count].base = base;
+	rp->segments[rp->segment_count].size = sb.st_size;
+
+	// Walk block headers only; a torn block at the end (crash) is ignored
+	size_t off = sizeof(HistoryFileHeader);
+	while (off + sizeof(HistoryBlockHeader) <= (size_t)sb.st_size) {
+		const HistoryBlockHeader *bh = (const HistoryBlockHeader *)(base + off);
+		if (bh->magic != HISTORY_BLOCK_MAGIC || bh->count == 0) {
+			break;
+		}
+		size_t len = sizeof(*bh);
+		for (int c = 0; c < HISTORY_COLUMNS; c++) {
+			len += bh->column_bytes[c];
+		}
+		if (off + len > (size_t)sb.st_size) {
+			break;
+		}
+
+		ReplayBlock *blocks = realloc(rp->blocks, (rp->block_count + 1) * sizeof(ReplayBlock));
+		if (!blocks) {
+			break;
+		}
+		rp->blocks = blocks;
+		ReplayBlock *blk = &rp->blocks[rp->block_count];
+		blk->t_min = bh->t_min;
+		blk->t_max_running = bh->t_max;
+		if (rp->block_count > 0 && rp->blocks[rp->block_count - 1].t_max_running > blk->t_max_running) {
+			blk->t_max_running = rp->blocks[rp->block_count - 1].t_max_running;
+		}
+		blk->segment = rp->segment_count;
+		blk->count = bh->count;
+		blk->offset = off;
+		rp->block_count++;
+		off += len;
+	}
+
+	rp->segment_count++;
+	return 0;
+}
+
+// Index every *.adsb segment in dir, in time (file name) order
+int replay_open(Replay *rp, const char *dir) {
+	memset(rp, 0, sizeof(*rp));
+	rp->speed = 1.0;
+
+	DIR *d = opendir(dir);
+	if (!d) {
+		fprintf(stderr, "replay: cannot open %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	char **names = NULL;
+	int count = 0;
+	struct dirent *de;
+	while ((de = readdir(d))) {
+		size_t len = strlen(de->d_name);
+		if (len > 5 && strcmp(de->d_name + len - 5, ".adsb") == 0) {
+			char **ptr = realloc(names, (count + 1) * sizeof(char *));
+			if (!ptr) break;
+			names = ptr;
+			names[count++] = strdup(de->d_name);
+		}
+	}
+	closedir(d);
+	qsort(names, count, sizeof(char *), compare_names);
+
+	for (int i = 0; i < count; i++) {
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		replay_index_segment(rp, path);
+		free(names[i]);
+	}
+	free(names);
+
+	if (rp->block_count == 0) {
+		fprintf(stderr, "replay: no recorded states in %s\n", dir);
+		return -1;
+	}
+	rp->first_time = rp->blocks[0].t_min;
+	rp->last_time = rp->blocks[rp->block_count - 1].t_max_running;
+	return 0;
+}
+
+void replay_close(Replay *rp) {
+	for (int i = 0; i < rp->segment_count; i++) {
+		munmap((void *)rp->segments[i].base, rp->segments[i].size);
+	}
+	free(rp->segments);
+	free(rp->blocks);
+	rp->segments = NULL;
+	rp->blocks = NULL;
+}
+
+// First block that can hold a state at or after t: O(log n) on the running max
+size_t replay_seek(const Replay *rp, int64_t t) {
+	size_t lo = 0, hi = rp->block_count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (rp->blocks[mid].t_max_running < t) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static inline int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+	uint64_t result = 0;
+	int shift = 0;
+	while (*p < end && shift < 64) {
+		uint8_t b = *(*p)++;
+		result |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			*v = result;
+			return 0;
+		}
+		shift += 7;
+	}
+	return -1;
+}
+
+// Decode all columns of one block into recs (room for blk->count records)
+int replay_decode_block(const Replay *rp, const ReplayBlock *blk, HistoryRecord *recs) {
+	const ReplaySegment *seg = &rp->segments[blk->segment];
+	const HistoryBlockHeader *bh = (const HistoryBlockHeader *)(seg->base + blk->offset);
+	const uint8_t *p = seg->base + blk->offset + sizeof(*bh);
+
+	for (int c = 0; c < HISTORY_COLUMNS; c++) {
+		const uint8_t *end = p + bh->column_bytes[c];
+		int64_t prev = 0;
+		for (uint32_t i = 0; i < blk->count; i++) {
+			uint64_t z;
+			if (get_varint(&p, end, &z) < 0) {
+				return -1;
+			}
+			prev += (int64_t)((z >> 1) ^ -(z & 1));
+			switch (c) {
+				case 0: recs[i].time = prev; break;
+				case 1: recs[i].icao24 = prev; break;
+				case 2: recs[i].lat = prev; break;
+				case 3: recs[i].lon = prev; break;
+				case 4: recs[i].altitude = prev; break;
+				case 5: recs[i].velocity = prev; break;
+				default: recs[i].track = prev; break;
+			}
+		}
+		p = end;
+	}
+	return 0;
+}
+
+// Current replay time from the clock anchor
+double replay_now(const Replay *rp) {
+	if (rp->paused) {
+		return rp->anchor_time;
+	}
+	double t = rp->anchor_time + elapsed_ms(&rp->anchor_wall) / 1000.0 * rp->speed;
+	return t > rp->last_time ? rp->last_time : t;
+}
+
+// Re-anchor the clock at replay time t (used for seek, speed change and pause)
+void replay_set_time(Replay *rp, double t) {
+	if (t < rp->first_time) t = rp->first_time;
+	if (t > rp->last_time) t = rp->last_time;
+	rp->anchor_time = t;
+	clock_gettime(CLOCK_MONOTONIC, &rp->anchor_wall);
+}
+
+// Build the picture at replay time t: latest state per aircraft in the window.
+// Output and scratch space come from the arena.
+int replay_picture(Replay *rp, Arena *arena, int64_t t, Aircraft **aircraft_list, int *count) {
+	size_t first = replay_seek(rp, t - REPLAY_WINDOW_S);
+	size_t last = first;
+	size_t total = 0;
+	while (last < rp->block_count && rp->blocks[last].t_min <= t) {
+		total += rp->blocks[last].count;
+		last++;
+	}
+
+	*count = 0;
+	*aircraft_list = arena_alloc(arena, (total ? total : 1) * sizeof(Aircraft));
+	HistoryRecord *recs = arena_alloc(arena, (total ? total : 1) * sizeof(HistoryRecord));
+
+	// Open-addressing map icao24 -> index in aircraft_list
+	size_t slots = 16;
+	while (slots < total * 2) {
+		slots *= 2;
+	}
+	int *map = arena_alloc(arena, slots * sizeof(int));
+	if (!*aircraft_list || !recs || !map) {
+		return -1;
+	}
+	memset(map, 0xFF, slots * sizeof(int));
+
+	size_t n = 0;
+	for (size_t b = first; b < last; b++) {
+		if (replay_decode_block(rp, &rp->blocks[b], recs + n) < 0) {
+			continue;
+		}
+		n += rp->blocks[b].count;
+		rp->blocks_decoded++;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		const HistoryRecord *rec = &recs[i];
+		if (rec->time > t || rec->time <= t - REPLAY_WINDOW_S) {
+			continue;
+		}
+
+		size_t slot = ((uint64_t)rec->icao24 * 0x9E3779B97F4A7C15ull) >> 32 & (slots - 1);
+		while (map[slot] >= 0 && (*aircraft_list)[map[slot]].icao24 != (uint32_t)rec->icao24) {
+			slot = (slot + 1) & (slots - 1);
+		}
+
+		Aircraft *ac;
+		if (map[slot] < 0) {
+			map[slot] = (*count)++;
+			ac = &(*aircraft_list)[map[slot]];
+		} else {
+			ac = &(*aircraft_list)[map[slot]];
+			if (ac->timestamp > rec->time) {
+				continue;
+			}
+		}
+
+		ac->icao24 = rec->icao24;
+		ac->timestamp = rec->time;
+		ac->latitude = rec->lat / 1e5;
+		ac->longitude = rec->lon / 1e5;
+		ac->altitude = rec->altitude / 10.0;
+		ac->velocity = rec->velocity / 100.0;
+		ac->track = rec->track >= 0 ? rec->track / 100.0 : -1.0;
+		ac->squawk = 0;
+		snprintf(ac->callsign, sizeof(ac->callsign), "%06X", ac->icao24);
+		ac->distance = calculate_distance(view.lat, view.lon, ac->latitude, ac->longitude);
+	}
+
+	rp->updates++;
+	return 0;
+}
+
+// Parse a replay start time: unix seconds or UTC "YYYY-MM-DD[THH:MM[:SS]]"
+static int64_t parse_time(const char *text) {
+	char *end;
+	long long secs = strtoll(text, &end, 10);
+	if (*end == '\0') {
+		return secs;
+	}
+
+	struct tm tm;
+	memset(&tm, 0, sizeof(tm));
+	const char *formats[] = {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d %H:%M:%S",
+	                         "%Y-%m-%d %H:%M", "%Y-%m-%d"};
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		memset(&tm, 0, sizeof(tm));
+		end = strptime(text, formats[i], &tm);
+		if (end && (*end == '\0' || *end == 'Z')) {
+			return timegm(&tm);
+		}
+	}
+	return -1;
+}
+
+// Snapshot of the last known picture (tracks and weather), rewritten every
+// SNAPSHOT_INTERVAL_S while live data flows. On launch it is mapped and shown,
+// marked stale, until the first poll returns.
+#define SNAPSHOT_MAGIC "ADSBSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_INTERVAL_S 30
+
+// Aircraft and weather cells follow the header as raw arrays
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;    // sizeof(Aircraft), rejects files from other builds
+	uint32_t aircraft_count;
+	uint32_t weather_count;
+	int64_t saved_at;        // unix seconds
+	double center_lat;       // view the weather cells are placed in (nm from
+	double center_lon;       // the center); another view rejects the file
+	double range_nm;
+} SnapshotHeader;
+
+typedef struct {
+	const uint8_t *base;     // NULL when no snapshot is mapped
+	size_t size;
+	int64_t saved_at;
+	Aircraft *aircraft;      // points into the read-only mapping
+	int aircraft_count;
+} Snapshot;
+
+// Default location: $HOME/.cache/aircraft_display_radar.snap
+const char *default_snapshot_path(void) {
+	static char path[PATH_MAX];
+	const char *home = getenv("HOME");
+	if (!home || !home[0]) {
+		return NULL;
+	}
+	snprintf(path, sizeof(path), "%s/.cache", home);
+	mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/.cache/aircraft_display_radar.snap", home);
+	return path;
+}
+
+// Write the picture to a temporary file and rename it over the old snapshot,
+// so a crash never leaves a torn file behind
+int snapshot_save(const char *path, const Aircraft *aircraft, int aircraft_count,
+                  const WeatherField *weather) {
+	char tmp[PATH_MAX + 8];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.record_size = sizeof(Aircraft);
+	header.aircraft_count = aircraft_count;
+	header.weather_count = weather->count;
+	header.saved_at = time(NULL);
+	header.center_lat = view.lat;
+	header.center_lon = view.lon;
+	header.range_nm = view.range_nm;
+
+	struct iovec iov[3] = {
+		{&header, sizeof(header)},
+		{(void *)aircraft, aircraft_count * sizeof(Aircraft)},
+		{(void *)weather->cells, weather->count * sizeof(WeatherCell)},
+	};
+	size_t total = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+	ssize_t written = writev(fd, iov, 3);
+	close(fd);
+
+	if (written != (ssize_t)total || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+// Map a snapshot; weather is copied out, aircraft stay in the mapping
+int snapshot_load(Snapshot *snap, const char *path, WeatherField *weather) {
+	memset(snap, 0, sizeof(*snap));
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat sb;
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(SnapshotHeader)) {
+		close(fd);
+		return -1;
+	}
+	const uint8_t *base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+	const SnapshotHeader *header = (const SnapshotHeader *)base;
+	size_t expected = sizeof(*header) + (size_t)header->aircraft_count * sizeof(Aircraft) +
+	                  (size_t)header->weather_count * sizeof(WeatherCell);
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != SNAPSHOT_VERSION || header->record_size != sizeof(Aircraft) ||
+	    header->weather_count > MAX_WEATHER_CELLS || expected != (size_t)sb.st_size ||
+	    header->center_lat != view.lat || header->center_lon != view.lon || header->range_nm != view.range_nm) {
+		munmap((void *)base, sb.st_size);
+		return -1;
+	}
+
+	snap->base = base;
+	snap->size = sb.st_size;
+	snap->saved_at = header->saved_at;
+	snap->aircraft = (Aircraft *)(base + sizeof(*header));
+	snap->aircraft_count = header->aircraft_count;
+
+	weather->count = header->weather_count;
+	memcpy(weather->cells, base + sizeof(*header) + header->aircraft_count * sizeof(Aircraft),
+	       header->weather_count * sizeof(WeatherCell));
+	return 0;
+}
+
+void snapshot_close(Snapshot *snap) {
+	if (snap->base) {
+		munmap((void *)snap->base, snap->size);
+		snap->base = NULL;
+		snap->aircraft = NULL;
+		snap->aircraft_count = 0;
+	}
+}
+
+// Screen size limits (sweep table stores 16-bit coordinates)
+#define MIN_SCREEN_HEIGHT 12
+#define MIN_SCREEN_WIDTH 24
+#define MAX_SCREEN_DIM 4096
+
+// Event loop timing
+#define FRAME_INTERVAL_MS 7
+#define NUM_ANGLES 720
+#define FETCH_INTERVAL_S 10
+#define WEATHER_FETCH_INTERVAL_S 60  // Update weather every 60 seconds
+
+// Precomputed sweep table: every screen cell binned by the sweep step whose
+// wedge contains it, stored CSR-style (cells of step s are start[s]..start[s+1])
+typedef struct {
+	uint16_t x;
+	uint16_t y;
+} SweepCell;
+
+typedef struct {
+	int width;
+	int height;
+	int *start;        // NUM_ANGLES + 1 offsets into cells
+	SweepCell *cells;  // width * height entries
+	uint16_t *step_of; // sweep step of each cell, y * width + x
+} SweepTable;
+
+// Sweep-synchronized painting, as on a real PPI: aircraft are indexed by the
+// sweep step of their bearing from the center, and each step repaints only the
+// targets in its wedge, at their dead-reckoned position for that instant.
+// Trail cells changed by a poll are queued per step the same way, so only a
+// weather update still needs a full wedge-by-wedge copy.
+#define TARGET_MAX_EXTRAPOLATION_S 30.0
+
+typedef struct {
+	uint32_t icao24;
+	Footprint layout;           // where draw_aircraft_layer put it in temp_screen
+	Footprint shown;            // where it is on screen now
+	int has_layout;             // 0 for a vanished aircraft that only needs erasing
+	int is_shown;
+	double latitude;            // dead reckoning base
+	double longitude;
+	double track;               // degrees, -1 when unknown
+	double velocity;            // m/s
+	double age;                 // seconds from the report to the layout
+} Target;
+
+typedef struct {
+	Target *targets;
+	Target *spare;              // previous generation while rebuilding
+	int count;
+	int cap;
+	int *order;                 // target indices grouped by sweep step
+	int start[NUM_ANGLES + 1];
+	int *lookup;                // scratch icao24 hash of the previous targets
+	size_t lookup_cap;
+	uint32_t *owner;            // TARGET_TAG of the aircraft each screen cell shows
+	int width;
+	int height;
+	double layout_time;         // data time of the layout, unix seconds
+	double speed;               // data seconds per wall second, 0 to hold still
+	struct timespec layout_wall;
+	uint64_t paints;
+	uint64_t cells;             // screen cells changed by paints and erases
+} TargetIndex;
+
+// Single cells waiting for the beam: one linked list per sweep step
+typedef struct {
+	int head[NUM_ANGLES];       // -1 when empty
+	int *next;
+	int *cell;                  // y * width + x
+	int free_head;
+	int cap;
+} RevealQueue;
+
+// Aircraft in heavy weather, checked every frame. Dead-reckoning bases are
+// kept as arrays of floats in nautical miles from the center, so projecting them
+// as latlon_to_screen does and looking up the weather layer cell under each
+// one runs a vector of aircraft at a time. An aircraft dead-reckoned off the
+// screen is looked up at its layout cell, where target_position leaves it.
+#define HAZARD_LANES 8          // arrays are padded to the widest vector
+
+typedef struct {
+	int count;
+	int cap;
+	float *x_nm;                // east of the center at the layout time
+	float *y_nm;                // north of the center
+	float *vx;                  // nm per second east, 0 without a track
+	float *vy;
+	float *age;                 // seconds from the report to the layout
+	float *layout_x;            // symbol column and row at the layout
+	float *layout_y;
+	int *aircraft;              // index into the aircraft list
+	int32_t *band;              // weather under each aircraft this frame
+	int *hits;                  // entries in WEATHER_HEAVY or worse, nearest first
+	int hit_count;
+	uint64_t checks;
+} WeatherHazard;
+
+void free_hazard(WeatherHazard *wh) {
+	free(wh->x_nm);
+	memset(wh, 0, sizeof(*wh));
+}
+
+// Take the targets of a fresh layout, nearest first as the labels were placed
+int hazard_rebuild(WeatherHazard *wh, const LabelPlacer *lp, const Aircraft *aircraft_list, double layout_time) {
+	int n = lp->target_count;
+	if (n > wh->cap) {
+		int cap = (n * 2 + HAZARD_LANES - 1) & ~(HAZARD_LANES - 1);
+		float *block = malloc((size_t)cap * 10 * sizeof(float));
+		if (!block) {
+			return -1;
+		}
+		free(wh->x_nm);
+		wh->x_nm = block;
+		wh->y_nm = block + cap;
+		wh->vx = block + 2 * cap;
+		wh->vy = block + 3 * cap;
+		wh->age = block + 4 * cap;
+		wh->aircraft = (int *)(block + 5 * cap);
+		wh->band = (int32_t *)(block + 6 * cap);
+		wh->hits = (int *)(block + 7 * cap);
+		wh->layout_x = block + 8 * cap;
+		wh->layout_y = block + 9 * cap;
+		wh->cap = cap;
+	}
+
+	for (int i = 0; i < n; i++) {
+		const Aircraft *ac = &aircraft_list[lp->targets[i].index];
+		double x_nm, y_nm;
+		project(ac->latitude, ac->longitude, &x_nm, &y_nm);
+		wh->aircraft[i] = lp->targets[i].index;
+		wh->x_nm[i] = (float)x_nm;
+		wh->y_nm[i] = (float)y_nm;
+		wh->age[i] = (float)(layout_time - ac->timestamp);
+		wh->layout_x[i] = (float)(lp->targets[i].fp.x / 2);
+		wh->layout_y[i] = (float)lp->targets[i].fp.y;
+		wh->vx[i] = wh->vy[i] = 0;
+		if (ac->track >= 0 && ac->velocity > 0) {
+			// As target_position moves it, one second along the track in
+			// latitude and longitude, then projected
+			double speed_nm = ac->velocity / 1852.0, track = ac->track * M_PI / 180.0;
+			double lat = ac->latitude + speed_nm * cos(track) / 60.0;
+			double lon = ac->longitude + speed_nm * sin(track) / (60.0 * cos(ac->latitude * M_PI / 180.0));
+			double x1, y1;
+			project(lat, lon, &x1, &y1);
+			wh->vx[i] = (float)(x1 - x_nm);
+			wh->vy[i] = (float)(y1 - y_nm);
+		}
+	}
+	wh->count = n;
+	wh->hit_count = 0;
+	return 0;
+}
+
+// Weather band under every aircraft dt seconds after the layout, on the
+// layer of matrix; fills hits with those in WEATHER_HEAVY or worse
+void hazard_check(WeatherHazard *wh, const Matrix *m, double dt) {
+	int width = m->width, height = m->height;
+	const WeatherIntensity *weather = m->weather[0];
+	float scale = (float)screen_scale(width, height);
+	float cx = (float)(width / 4), cy = (float)(height / 2);
+	float max_x = (float)(width / 2 - 1), min_y = 1.0f, max_y = (float)(height - 1);
+	float lead = (float)dt, max_lead = (float)TARGET_MAX_EXTRAPOLATION_S;
+	int n = wh->count, i = 0;
+
+	wh->hit_count = 0;
+	if (!weather) {
+		return;
+	}
+#if defined(__AVX2__)
+	const __m256 vlead = _mm256_set1_ps(lead), vmax_lead = _mm256_set1_ps(max_lead);
+	const __m256 vscale = _mm256_set1_ps(scale), vwidth = _mm256_set1_ps((float)width);
+	const __m256 vcx = _mm256_set1_ps(cx), vcy = _mm256_set1_ps(cy), zero = _mm256_setzero_ps();
+	const __m256 vmax_x = _mm256_set1_ps(max_x), vmin_y = _mm256_set1_ps(min_y), vmax_y = _mm256_set1_ps(max_y);
+	const __m256i light = _mm256_set1_epi32(WEATHER_HEAVY - 1);
+	for (; i + 8 <= n; i += 8) {
+		__m256 t = _mm256_add_ps(vlead, _mm256_loadu_ps(wh->age + i));
+		t = _mm256_min_ps(_mm256_max_ps(t, zero), vmax_lead);
+		__m256 x = _mm256_add_ps(_mm256_loadu_ps(wh->x_nm + i), _mm256_mul_ps(_mm256_loadu_ps(wh->vx + i), t));
+		__m256 y = _mm256_add_ps(_mm256_loadu_ps(wh->y_nm + i), _mm256_mul_ps(_mm256_loadu_ps(wh->vy + i), t));
+		__m256 sx = _mm256_add_ps(vcx, _mm256_round_ps(_mm256_mul_ps(x, vscale), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+		__m256 sy = _mm256_sub_ps(vcy, _mm256_round_ps(_mm256_mul_ps(y, vscale), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+		__m256 in = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(sx, zero, _CMP_GE_OQ), _mm256_cmp_ps(sx, vmax_x, _CMP_LE_OQ)),
+		                          _mm256_and_ps(_mm256_cmp_ps(sy, vmin_y, _CMP_GE_OQ), _mm256_cmp_ps(sy, vmax_y, _CMP_LE_OQ)));
+		sx = _mm256_blendv_ps(_mm256_loadu_ps(wh->layout_x + i), sx, in);
+		sy = _mm256_blendv_ps(_mm256_loadu_ps(wh->layout_y + i), sy, in);
+		__m256i cell = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(sy, vwidth), _mm256_add_ps(sx, sx)));
+		__m256i band = _mm256_i32gather_epi32((const int *)weather, cell, 4);
+		_mm256_storeu_si256((__m256i *)(wh->band + i), band);
+		unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(band, light)));
+		for (; mask; mask &= mask - 1) {
+			wh->hits[wh->hit_count++] = i + __builtin_ctz(mask);
+		}
+	}
+#elif defined(__SSE2__)
+	// No gather: the cell indices go through memory
+	const __m128 vlead = _mm_set1_ps(lead), vmax_lead = _mm_set1_ps(max_lead);
+	const __m128 vscale = _mm_set1_ps(scale), vwidth = _mm_set1_ps((float)width);
+	const __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy), zero = _mm_setzero_ps();
+	const __m128 vmax_x = _mm_set1_ps(max_x), vmin_y = _mm_set1_ps(min_y), vmax_y = _mm_set1_ps(max_y);
+	const __m128i light = _mm_set1_epi32(WEATHER_HEAVY - 1);
+	for (; i + 4 <= n; i += 4) {
+		__m128 t = _mm_add_ps(vlead, _mm_loadu_ps(wh->age + i));
+		t = _mm_min_ps(_mm_max_ps(t, zero), vmax_lead);
+		__m128 x = _mm_add_ps(_mm_loadu_ps(wh->x_nm + i), _mm_mul_ps(_mm_loadu_ps(wh->vx + i), t));
+		__m128 y = _mm_add_ps(_mm_loadu_ps(wh->y_nm + i), _mm_mul_ps(_mm_loadu_ps(wh->vy + i), t));
+		__m128 sx = _mm_add_ps(vcx, _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(x, vscale))));
+		__m128 sy = _mm_sub_ps(vcy, _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(y, vscale))));
+		__m128 in = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(sx, zero), _mm_cmple_ps(sx, vmax_x)),
+		                       _mm_and_ps(_mm_cmpge_ps(sy, vmin_y), _mm_cmple_ps(sy, vmax_y)));
+		sx = _mm_or_ps(_mm_and_ps(in, sx), _mm_andnot_ps(in, _mm_loadu_ps(wh->layout_x + i)));
+		sy = _mm_or_ps(_mm_and_ps(in, sy), _mm_andnot_ps(in, _mm_loadu_ps(wh->layout_y + i)));
+		int32_t cell[4];
+		_mm_storeu_si128((__m128i *)cell, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(sy, vwidth), _mm_add_ps(sx, sx))));
+		__m128i band = _mm_setr_epi32(weather[cell[0]], weather[cell[1]], weather[cell[2]], weather[cell[3]]);
+		_mm_storeu_si128((__m128i *)(wh->band + i), band);
+		unsigned mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(band, light)));
+		for (; mask; mask &= mask - 1) {
+			wh->hits[wh->hit_count++] = i + __builtin_ctz(mask);
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		float t = lead + wh->age[i];
+		t = t < 0 ? 0 : (t > max_lead ? max_lead : t);
+		float sx = cx + truncf((wh->x_nm[i] + wh->vx[i] * t) * scale);
+		float sy = cy - truncf((wh->y_nm[i] + wh->vy[i] * t) * scale);
+		if (sx < 0 || sx > max_x || sy < min_y || sy > max_y) {
+			sx = wh->layout_x[i];
+			sy = wh->layout_y[i];
+		}
+		wh->band[i] = weather[(int)(sy * width + sx + sx)];
+		if (wh->band[i] >= WEATHER_HEAVY) {
+			wh->hits[wh->hit_count++] = i;
+		}
+	}
+	wh->checks++;
+}
+
+// Aircraft classified into the airspace they are in at each layout, at
+// their reported position and barometric altitude
+typedef struct {
+	int count;
+	int cap;
+	int *aircraft;              // index into the aircraft list, nearest first
+	int *area;                  // area each one is in, -1 for none
+	int *hits;                  // entries inside a restricted, danger or prohibited area
+	int hit_count;
+	uint64_t classified;
+	double classify_ms;         // all layouts so far
+} AirspaceCheck;
+
+void free_airspace_check(AirspaceCheck *chk) {
+	free(chk->aircraft);
+	memset(chk, 0, sizeof(*chk));
+}
+
+// Classify the targets of a fresh layout
+int airspace_classify(AirspaceCheck *chk, const AirspaceMask *am, const Overlay *ov,
+                      const LabelPlacer *lp, const Aircraft *aircraft_list) {
+	int n = lp->target_count;
+	if (n > chk->cap) {
+		int cap = n * 2;
+		int *block = malloc((size_t)cap * 3 * sizeof(int));
+		if (!block) {
+			return -1;
+		}
+		free(chk->aircraft);
+		chk->aircraft = block;
+		chk->area = block + cap;
+		chk->hits = block + 2 * cap;
+		chk->cap = cap;
+	}
+
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	chk->hit_count = 0;
+	for (int i = 0; i < n; i++) {
+		const Aircraft *ac = &aircraft_list[lp->targets[i].index];
+		int a = airspace_lookup(am, ov, ac->latitude, ac->longitude, ac->altitude * 3.28084);
+		chk->aircraft[i] = lp->targets[i].index;
+		chk->area[i] = a;
+		if (a >= 0 && ov->areas[a].restricted) {
+			chk->hits[chk->hit_count++] = i;
+		}
+	}
+	chk->count = n;
+	chk->classified += n;
+	chk->classify_ms += elapsed_ms(&t0);
+	return 0;
+}
+
+// Command line options
+typedef struct {
+	double max_rate;    // output cap in bytes per second, 0 = unlimited
+	const char *history_dir;  // record accepted states here, NULL = off
+	const char *replay_dir;   // replay recorded history instead of polling
+	int64_t replay_from;      // replay start (unix seconds), -1 = first record
+	double replay_speed;
+	const char *snapshot_path; // warm-start snapshot, NULL = off
+	const char *radar_dir;    // ODIM-HDF5 radar composites, NULL = simulated weather
+	const char *airport;      // view center: ICAO code or "LAT,LON"
+	double range_nm;          // view radius to the nearer screen edge
+	int headless;       // count output bytes instead of writing them
+	int duration_s;     // stop after this many seconds, 0 = run until quit
+	int bench_labels;   // run the label placement benchmark with this many aircraft
+	int bench_maxpool;  // run the max-pool benchmark and exit
+	int afterglow;      // phosphor afterglow behind the sweep (off under a rate cap)
+	int no_nowcast;     // hold weather still between refreshes
+	int outline;        // draw weather as contours instead of filled
+	const char *overlay_files[OVERLAY_MAX_FILES];  // GeoJSON airspace/navaid files
+	int overlay_count;
+	const char *bench_nowcast;  // run the nowcast benchmark on composites in this dir
+	const char *bench_airspace; // check and time airspace classification on this file
+} RadarOptions;
+
+// Event loop state: every fd the loop multiplexes plus the display buffers
+typedef struct {
+	RadarOptions opts;
+	int epfd;
+	int frame_fd;       // timerfd driving the sweep/frame tick
+	int poll_fd;        // timerfd for aircraft polling
+	int weather_fd;     // timerfd for weather refresh
+	int curl_timer_fd;  // timerfd backing the curl_multi timeout
+	int signal_fd;      // SIGINT/SIGTERM/SIGWINCH
+	int stdin_fd;       // -1 when stdin is not a terminal
+	int stop_fd;        // timerfd for --duration, -1 when unused
+
+	CURLM *multi;
+	CURL *aircraft_easy;             // reused across polls to keep the connection
+	int aircraft_busy;               // request in flight on aircraft_easy
+	struct MemoryStruct aircraft_chunk;
+	Arena poll_arenas[2];            // one holds the shown list, the other the next poll
+	int poll_arena;                  // index of the arena the next poll may reset
+
+	Matrix *screen;
+	Matrix *temp_screen;
+	WeatherIntensity *outline;  // contours of temp_screen's weather in outline mode
+	Overlay overlay;            // airspace, runways and navaids from --overlay
+	uint8_t *overlay_cells;     // overlay rasterized for the current screen size
+	SweepTable sweep;
+	Renderer renderer;
+	BandwidthLimit bandwidth;
+	HistoryStore history;
+	WeatherWorker weather_worker;
+	TrackTable tracks;  // trails, drawn into temp_screen
+	TargetIndex targets; // aircraft painted as the beam passes them
+	WeatherHazard hazard; // aircraft in heavy weather, for the panel
+	AirspaceMask airspace; // areas of the overlay, for classifying aircraft
+	AirspaceCheck airspace_check;
+	RevealQueue reveal; // changed trail cells waiting for the beam
+	Replay replay;
+	int replaying;
+	char status[64];    // appended to the title line
+	Snapshot snapshot;  // shown until the first live poll
+	struct timespec last_snapshot;
+	int live;           // a poll has succeeded since launch
+	int current_angle;
+	int reveal_steps;   // sweep steps until screen has caught up with temp_screen
+	int running;
+	int resize_pending;
+
+	// Last picture, kept so a resize can redraw without waiting for the next poll
+	Aircraft *aircraft;
+	int aircraft_count;
+	WeatherField weather;
+
+	// Resize rebuild cost
+	int resize_count;
+	double last_resize_ms;
+	double max_resize_ms;
+
+	struct termios saved_termios;
+	int termios_saved;
+} RadarState;
+
+// Drop every queued cell, keeping the storage
+void reveal_queue_clear(RevealQueue *q) {
+	for (int s = 0; s < NUM_ANGLES; s++) {
+		q->head[s] = -1;
+	}
+	for (int i = 0; i < q->cap; i++) {
+		q->next[i] = i + 1 < q->cap ? i + 1 : -1;
+	}
+	q->free_head = q->cap ? 0 : -1;
+}
+
+// Queue one cell for the sweep step s
+static int reveal_queue_push(RevealQueue *q, int s, int cell) {
+	if (q->free_head < 0) {
+		int cap = q->cap ? q->cap * 2 : 1024;
+		int *next = realloc(q->next, cap * sizeof(int));
+		if (next) q->next = next;
+		int *cells = realloc(q->cell, cap * sizeof(int));
+		if (cells) q->cell = cells;
+		if (!next || !cells) {
+			return -1;
+		}
+		for (int i = q->cap; i < cap; i++) {
+			q->next[i] = i + 1 < cap ? i + 1 : -1;
+		}
+		q->free_head = q->cap;
+		q->cap = cap;
+	}
+	int e = q->free_head;
+	q->free_head = q->next[e];
+	q->cell[e] = cell;
+	q->next[e] = q->head[s];
+	q->head[s] = e;
+	return 0;
+}
+
+void free_reveal_queue(RevealQueue *q) {
+	free(q->next);
+	free(q->cell);
+}
+
+// Owner tag of screen cells painted for an aircraft, 0 = none
+#define TARGET_TAG(icao24) ((icao24) | 0x1000000u)
+
+// Write one aircraft-layer cell of the screen (never the title row)
+static inline void target_put(Matrix *screen, Renderer *r, TargetIndex *ti, int y, int x,
+                              char ch, uint32_t tag) {
+	if (y < 1 || y >= screen->height || x < 0 || x >= screen->width) {
+		return;
+	}
+	ti->owner[y * screen->width + x] = tag;
+	if (screen->data[y][x] != ch) {
+		screen->data[y][x] = ch;
+		mark_dirty(r, LAYER_AIRCRAFT, y, x);
+		ti->cells++;
+	}
+}
+
+// Blank a cell if it still shows this aircraft; a neighbour painted over it keeps it
+static inline void target_clear(Matrix *screen, Renderer *r, TargetIndex *ti, int y, int x, uint32_t tag) {
+	if (y < 1 || y >= screen->height || x < 0 || x >= screen->width ||
+	    ti->owner[y * screen->width + x] != tag) {
+		return;
+	}
+	int marker = y == screen->height / 2 && x == (screen->width / 4) * 2;
+	target_put(screen, r, ti, y, x, marker ? '+' : ' ', 0);
+}
+
+static void footprint_erase(Matrix *screen, Renderer *r, TargetIndex *ti, const Footprint *fp, uint32_t tag) {
+	target_clear(screen, r, ti, fp->y, fp->x, tag);
+	for (int k = 1; k <= fp->leader; k++) {
+		target_clear(screen, r, ti, fp->y + fp->dy * k, fp->x + fp->dx * 2 * k, tag);
+	}
+	for (int i = 0; i < fp->lines; i++) {
+		for (int j = 0; j < fp->width; j++) {
+			target_clear(screen, r, ti, fp->top + i, fp->left + j, tag);
+		}
+	}
+}
+
+// Copy a footprint's glyphs from the layout to the screen, moved by (ox, oy)
+static void footprint_paint(Matrix *screen, const Matrix *layout, Renderer *r, TargetIndex *ti,
+                            const Footprint *fp, int ox, int oy, uint32_t tag) {
+	target_put(screen, r, ti, fp->y + oy, fp->x + ox, layout->data[fp->y][fp->x], tag);
+	for (int k = 1; k <= fp->leader; k++) {
+		int y = fp->y + fp->dy * k, x = fp->x + fp->dx * 2 * k;
+		target_put(screen, r, ti, y + oy, x + ox, layout->data[y][x], tag);
+	}
+	for (int i = 0; i < fp->lines; i++) {
+		const char *row = layout->data[fp->top + i];
+		for (int j = 0; j < fp->width; j++) {
+			if (row[fp->left + j] != ' ') {
+				target_put(screen, r, ti, fp->top + i + oy, fp->left + j + ox, row[fp->left + j], tag);
+			}
+		}
+	}
+}
+
+static inline Footprint footprint_moved(const Footprint *fp, int ox, int oy) {
+	Footprint moved = *fp;
+	moved.x += ox;
+	moved.y += oy;
+	moved.top += oy;
+	moved.left += ox;
+	return moved;
+}
+
+// Symbol cell of a target dead-reckoned dt seconds past its layout position
+static void target_position(const Target *t, double dt, const Matrix *m, int *x, int *y) {
+	*x = t->layout.x;
+	*y = t->layout.y;
+	dt += t->age;
+	if (dt <= 0 || t->track < 0 || t->velocity <= 0) {
+		return;
+	}
+	if (dt > TARGET_MAX_EXTRAPOLATION_S) {
+		dt = TARGET_MAX_EXTRAPOLATION_S;
+	}
+
+	double dist_nm = t->velocity * dt / 1852.0;
+	double track = t->track * M_PI / 180.0;
+	double lat = t->latitude + dist_nm * cos(track) / 60.0;
+	double lon = t->longitude + dist_nm * sin(track) / (60.0 * cos(t->latitude * M_PI / 180.0));
+
+	int sx, sy;
+	if (latlon_to_screen(lat, lon, &sx, &sy, m->width, m->height)) {
+		*x = sx * 2;
+		*y = sy;
+	}
+}
+
+static inline size_t target_hash(uint32_t icao24, size_t cap) {
+	return (size_t)((icao24 * 0x9E3779B1u) >> 8) & (cap - 1);
+}
+
+// Take over a fresh layout: targets keep what they have on screen until the
+// beam reaches them; aircraft that vanished stay behind as erase-only entries
+int targets_rebuild(TargetIndex *ti, const LabelPlacer *lp, const Aircraft *aircraft_list,
+                    const SweepTable *sweep, double layout_time, double speed) {
+	int old_count = ti->count;
+	int need = lp->target_count + old_count;
+	if (need > ti->cap) {
+		int cap = need * 2;
+		Target *targets = realloc(ti->targets, cap * sizeof(Target));
+		if (targets) ti->targets = targets;
+		Target *spare = realloc(ti->spare, cap * sizeof(Target));
+		if (spare) ti->spare = spare;
+		int *order = realloc(ti->order, cap * sizeof(int));
+		if (order) ti->order = order;
+		if (!targets || !spare || !order) {
+			return -1;
+		}
+		ti->cap = cap;
+	}
+
+	size_t lookup_cap = 16;
+	while (lookup_cap < (size_t)old_count * 2) {
+		lookup_cap *= 2;
+	}
+	if (lookup_cap > ti->lookup_cap) {
+		int *lookup = realloc(ti->lookup, lookup_cap * sizeof(int));
+		if (!lookup) {
+			return -1;
+		}
+		ti->lookup = lookup;
+		ti->lookup_cap = lookup_cap;
+	}
+
+	// Previous generation moves to spare, hashed by address
+	Target *old = ti->targets;
+	ti->targets = ti->spare;
+	ti->spare = old;
+	memset(ti->lookup, 0xFF, lookup_cap * sizeof(int));
+	for (int i = 0; i < old_count; i++) {
+		if (!old[i].is_shown) {
+			continue;
+		}
+		size_t h = target_hash(old[i].icao24, lookup_cap);
+		while (ti->lookup[h] >= 0) {
+			h = (h + 1) & (lookup_cap - 1);
+		}
+		ti->lookup[h] = i;
+	}
+
+	int count = 0;
+	for (int i = 0; i < lp->target_count; i++) {
+		const LabelTarget *lt = &lp->targets[i];
+		const Aircraft *ac = &aircraft_list[lt->index];
+		Target *t = &ti->targets[count++];
+		t->icao24 = ac->icao24;
+		t->layout = lt->fp;
+		t->has_layout = 1;
+		t->is_shown = 0;
+		t->latitude = ac->latitude;
+		t->longitude = ac->longitude;
+		t->track = ac->track;
+		t->velocity = ac->velocity;
+		t->age = layout_time - ac->timestamp;
+
+		size_t h = target_hash(ac->icao24, lookup_cap);
+		for (; ti->lookup[h] >= 0; h = (h + 1) & (lookup_cap - 1)) {
+			Target *prev = &old[ti->lookup[h]];
+			if (prev->icao24 == ac->icao24 && prev->is_shown) {
+				t->shown = prev->shown;
+				t->is_shown = 1;
+				prev->is_shown = 0;
+				break;
+			}
+		}
+	}
+	for (int i = 0; i < old_count; i++) {
+		if (old[i].is_shown) {
+			Target *t = &ti->targets[count++];
+			*t = old[i];
+			t->has_layout = 0;
+		}
+	}
+	ti->count = count;
+
+	// Counting sort by the sweep step of the symbol (where it is shown, for leftovers)
+	memset(ti->start, 0, sizeof(ti->start));
+	for (int i = 0; i < count; i++) {
+		const Footprint *fp = ti->targets[i].has_layout ? &ti->targets[i].layout : &ti->targets[i].shown;
+		ti->start[sweep->step_of[fp->y * sweep->width + fp->x] + 1]++;
+	}
+	for (int s = 0; s < NUM_ANGLES; s++) {
+		ti->start[s + 1] += ti->start[s];
+	}
+	int fill[NUM_ANGLES];
+	memcpy(fill, ti->start, sizeof(fill));
+	for (int i = 0; i < count; i++) {
+		const Footprint *fp = ti->targets[i].has_layout ? &ti->targets[i].layout : &ti->targets[i].shown;
+		ti->order[fill[sweep->step_of[fp->y * sweep->width + fp->x]]++] = i;
+	}
+
+	ti->layout_time = layout_time;
+	ti->speed = speed;
+	clock_gettime(CLOCK_MONOTONIC, &ti->layout_wall);
+	return 0;
+}
+
+// Size the owner map for a new screen; the old screen is gone with its targets
+int targets_resize(TargetIndex *ti, int height, int width) {
+	uint32_t *owner = calloc((size_t)width * height, sizeof(uint32_t));
+	if (!owner) {
+		return -1;
+	}
+	free(ti->owner);
+	ti->owner = owner;
+	ti->width = width;
+	ti->height = height;
+	ti->count = 0;
+	return 0;
+}
+
+// Everything is on screen as laid out (after a full copy)
+void targets_mark_shown(TargetIndex *ti, Matrix *screen, Renderer *r) {
+	for (int i = 0; i < ti->count; i++) {
+		Target *t = &ti->targets[i];
+		t->shown = t->layout;
+		t->is_shown = t->has_layout;
+		if (t->has_layout) {
+			footprint_paint(screen, screen, r, ti, &t->layout, 0, 0, TARGET_TAG(t->icao24));
+		}
+	}
+}
+
+void free_targets(TargetIndex *ti) {
+	free(ti->targets);
+	free(ti->spare);
+	free(ti->order);
+	free(ti->lookup);
+	free(ti->owner);
+}
+
+// Lay out the aircraft layer and hand it to the sweep: the title goes out at
+// once, targets and changed trail cells when the beam reaches them.
+// layout_time is the data time of the picture, speed how fast it advances.
+void layout_aircraft(RadarState *st, double layout_time, double speed) {
+	Matrix *screen = st->screen;
+	Matrix *layout = st->temp_screen;
+
+	draw_aircraft_layer(layout, st->aircraft, st->aircraft_count, weather_source(st->opts.radar_dir),
+	                    st->status, st->overlay.area_count ? 2 : 1);
+	targets_rebuild(&st->targets, &label_placer, st->aircraft, &st->sweep, layout_time, speed);
+	hazard_rebuild(&st->hazard, &label_placer, st->aircraft, layout_time);
+	if (st->overlay.area_count) {
+		airspace_classify(&st->airspace_check, &st->airspace, &st->overlay, &label_placer, st->aircraft);
+	}
+
+	if (screen) {
+		for (int x = 0; x < screen->width; x++) {
+			if (screen->data[0][x] != layout->data[0][x]) {
+				screen->data[0][x] = layout->data[0][x];
+				mark_dirty(&st->renderer, LAYER_AIRCRAFT, 0, x);
+			}
+		}
+	}
+
+	TrackTable *tt = &st->tracks;
+	for (size_t i = 0; i < tt->changed_count; i++) {
+		reveal_queue_push(&st->reveal, st->sweep.step_of[tt->changed[i]], tt->changed[i]);
+	}
+	tt->changed_count = 0;
+}
+
+// Data time the current layout has advanced to
+static double layout_clock(const TargetIndex *ti) {
+	return ti->layout_time + elapsed_ms(&ti->layout_wall) / 1000.0 * ti->speed;
+}
+
+static const char *const hazard_band_names[] = {"HEAVY", "V.HEAVY", "INTENSE", "EXTREME"};
+
+// Name of an aircraft in a panel: callsign, or the ICAO address without one
+static void panel_name(char *name, size_t size, const Aircraft *ac) {
+	if (ac->callsign[0]) {
+		snprintf(name, size, "%.8s", ac->callsign);
+	} else {
+		snprintf(name, size, "%06x", ac->icao24);
+	}
+}
+
+// Write one panel row straight to the screen; only cells that change are
+// redrawn, and blank panel cells a target has painted are left to it
+static void panel_show_line(RadarState *st, int r, int c0, int c1, const char *line) {
+	Matrix *screen = st->screen;
+	TargetIndex *ti = &st->targets;
+	int len = (int)strlen(line);
+	for (int c = c0; c <= c1; c++) {
+		char ch = c - c0 < len ? line[c - c0] : ' ';
+		size_t cell = (size_t)r * screen->width + c;
+		if ((ch == ' ' && ti->owner[cell] != 0) || screen->data[r][c] == ch) {
+			continue;
+		}
+		screen->data[r][c] = ch;
+		ti->owner[cell] = 0;
+		mark_dirty(&st->renderer, LAYER_AIRCRAFT, r, c);
+	}
+}
+
+// Check the aircraft against the newest weather layer and bring the panel up to date
+void hazard_update(RadarState *st) {
+	WeatherHazard *wh = &st->hazard;
+	TargetIndex *ti = &st->targets;
+	Matrix *screen = st->screen;
+	hazard_check(wh, st->temp_screen, elapsed_ms(&ti->layout_wall) / 1000.0 * ti->speed);
+
+	int r0, r1, c0, c1;
+	if (!hazard_panel_rect(screen->height, screen->width, PANEL_WEATHER, &r0, &r1, &c0, &c1)) {
+		return;
+	}
+	// A full panel ends in a count of the entries left out
+	int entries = wh->hit_count < HAZARD_PANEL_ROWS ? wh->hit_count : HAZARD_PANEL_ROWS - 2;
+	for (int r = r0; r <= r1; r++) {
+		int k = r - r0;
+		char line[HAZARD_PANEL_WIDTH + 1] = "";
+		if (wh->hit_count == 0) {
+			// Nothing to show
+		} else if (k == 0) {
+			snprintf(line, sizeof(line), " IN HEAVY WEATHER: %d", wh->hit_count);
+		} else if (k <= entries) {
+			int i = wh->hits[k - 1];
+			const Aircraft *ac = &st->aircraft[wh->aircraft[i]];
+			char name[12];
+			panel_name(name, sizeof(name), ac);
+			snprintf(line, sizeof(line), " %-8s %6dft %s", name, label_altitude(ac),
+			         hazard_band_names[wh->band[i] - WEATHER_HEAVY]);
+		} else if (k == entries + 1 && entries < wh->hit_count) {
+			snprintf(line, sizeof(line), " +%d more", wh->hit_count - entries);
+		}
+		panel_show_line(st, r, c0, c1, line);
+	}
+}
+
+// Bring the restricted airspace panel up to the last classification
+void airspace_update(RadarState *st) {
+	AirspaceCheck *chk = &st->airspace_check;
+	Matrix *screen = st->screen;
+
+	int r0, r1, c0, c1;
+	if (!st->overlay.area_count ||
+	    !hazard_panel_rect(screen->height, screen->width, PANEL_AIRSPACE, &r0, &r1, &c0, &c1)) {
+		return;
+	}
+	int entries = chk->hit_count < HAZARD_PANEL_ROWS ? chk->hit_count : HAZARD_PANEL_ROWS - 2;
+	for (int r = r0; r <= r1; r++) {
+		int k = r - r0;
+		char line[HAZARD_PANEL_WIDTH + 32] = "";    // cut to the panel when shown
+		if (chk->hit_count == 0) {
+			// Nothing to show
+		} else if (k == 0) {
+			snprintf(line, sizeof(line), " IN RESTRICTED AREA: %d", chk->hit_count);
+		} else if (k <= entries) {
+			int i = chk->hits[k - 1];
+			const Aircraft *ac = &st->aircraft[chk->aircraft[i]];
+			char name[12];
+			panel_name(name, sizeof(name), ac);
+			snprintf(line, sizeof(line), " %-8s %6dft %s", name, label_altitude(ac),
+			         st->overlay.areas[chk->area[i]].name);
+		} else if (k == entries + 1 && entries < chk->hit_count) {
+			snprintf(line, sizeof(line), " +%d more", chk->hit_count - entries);
+		}
+		panel_show_line(st, r, c0, c1, line);
+	}
+}
+
+// Arm a timerfd: first expiry after first_ms (0 = immediately), then every interval_ms (0 = one-shot)
+static int arm_timer(int fd, long first_ms, long interval_ms) {
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+
+	// A zero it_value disarms the timer, so "immediately" means one nanosecond
+	if (first_ms <= 0) {
+		its.it_value.tv_nsec = 1;
+	} else {
+		its.it_value.tv_sec = first_ms / 1000;
+		its.it_value.tv_nsec = (first_ms % 1000) * 1000000L;
+	}
+	its.it_interval.tv_sec = interval_ms / 1000;
+	its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+
+	return timerfd_settime(fd, 0, &its, NULL);
+}
+
+static void disarm_timer(int fd) {
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	timerfd_settime(fd, 0, &its, NULL);
+}
+
+// Drain a timerfd, returning the number of expirations since the last read
+static uint64_t read_timer(int fd) {
+	uint64_t expirations = 0;
+	if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+		return 0;
+	}
+	return expirations;
+}
+
+static int add_epoll_fd(int epfd, int fd, uint32_t events) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// curl_multi socket callback: mirror curl's interest set into epoll
+static int curl_socket_cb(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+	RadarState *st = (RadarState *)userp;
+	(void)easy;
+	(void)socketp;
+
+	if (what == CURL_POLL_REMOVE) {
+		epoll_ctl(st->epfd, EPOLL_CTL_DEL, s, NULL);
+		return 0;
+	}
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.data.fd = s;
+	if (what & CURL_POLL_IN) ev.events |= EPOLLIN;
+	if (what & CURL_POLL_OUT) ev.events |= EPOLLOUT;
+
+	if (epoll_ctl(st->epfd, EPOLL_CTL_MOD, s, &ev) < 0 && errno == ENOENT) {
+		epoll_ctl(st->epfd, EPOLL_CTL_ADD, s, &ev);
+	}
+	return 0;
+}
+
+// curl_multi timer callback: curl asks to be woken after timeout_ms (-1 = cancel)
+static int curl_timer_cb(CURLM *multi, long timeout_ms, void *userp) {
+	RadarState *st = (RadarState *)userp;
+	(void)multi;
+
+	if (timeout_ms < 0) {
+		disarm_timer(st->curl_timer_fd);
+	} else {
+		arm_timer(st->curl_timer_fd, timeout_ms, 0);
+	}
+	return 0;
+}
+
+// Queue a non-blocking aircraft request on the multi handle
+void start_aircraft_fetch(RadarState *st) {
+	// Previous request still running, let it finish
+	if (st->aircraft_busy) {
+		return;
+	}
+
+	if (!st->aircraft_easy) {
+		st->aircraft_easy = curl_easy_init();
+		if(!st->aircraft_easy) {
+			fprintf(stderr, "Failed to initialize CURL\n");
+			return;
+		}
+	}
+	CURL *curl = st->aircraft_easy;
+
+	// The arena not holding the displayed aircraft is free for this poll
+	Arena *arena = &st->poll_arenas[st->poll_arena];
+	arena_reset(arena);
+	st->aircraft_chunk.arena = arena;
+	st->aircraft_chunk.memory = arena_alloc(arena, 1);
+	if (!st->aircraft_chunk.memory) {
+		fprintf(stderr, "Not enough memory for the aircraft request\n");
+		return;
+	}
+	st->aircraft_chunk.memory[0] = '\0';
+	st->aircraft_chunk.size = 0;
+
+	char url[512];
+	build_aircraft_url(url, sizeof(url));
+
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&st->aircraft_chunk);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "aircraft-display/1.0");
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+
+	st->aircraft_busy = 1;
+	curl_multi_add_handle(st->multi, curl);
+}
+
+// Handle a completed aircraft request
+void finish_aircraft_fetch(RadarState *st, CURLcode res) {
+	curl_multi_remove_handle(st->multi, st->aircraft_easy);
+	st->aircraft_busy = 0;
+
+	if(res != CURLE_OK) {
+		fprintf(stderr, "curl request failed: %s\n", curl_easy_strerror(res));
+		return;
+	}
+
+	Aircraft *aircraft_list = NULL;
+	int aircraft_count = 0;
+	Arena *arena = st->aircraft_chunk.arena;
+
+	if(parse_aircraft_data(arena, st->aircraft_chunk.memory, st->aircraft_chunk.size,
+	                       &aircraft_list, &aircraft_count) == 0) {
+		// The new list lives in this arena; the old one's arena is next to reset
+		st->aircraft = aircraft_list;
+		st->aircraft_count = aircraft_count;
+		st->poll_arena ^= 1;
+		history_append(&st->history, st->aircraft, st->aircraft_count);
+		tracks_update(&st->tracks, st->temp_screen, st->aircraft, st->aircraft_count);
+
+		// Live data replaces the stale picture
+		if (!st->live) {
+			st->live = 1;
+			st->status[0] = '\0';
+			snapshot_close(&st->snapshot);
+		}
+		if (st->opts.snapshot_path && elapsed_ms(&st->last_snapshot) >= SNAPSHOT_INTERVAL_S * 1000.0) {
+			snapshot_save(st->opts.snapshot_path, st->aircraft, st->aircraft_count, &st->weather);
+			clock_gettime(CLOCK_MONOTONIC, &st->last_snapshot);
+		}
+		layout_aircraft(st, time(NULL), 1.0);
+	}
+}
+
+// Collect finished transfers after curl made progress
+static void check_multi_info(RadarState *st) {
+	CURLMsg *msg;
+	int pending;
+
+	while ((msg = curl_multi_info_read(st->multi, &pending))) {
+		if (msg->msg == CURLMSG_DONE && msg->easy_handle == st->aircraft_easy) {
+			finish_aircraft_fetch(st, msg->data.result);
+		}
+	}
+}
+
+// Replay counterpart of a poll: rebuild the picture at the current replay time
+void replay_update(RadarState *st) {
+	Replay *rp = &st->replay;
+	double now = replay_now(rp);
+	if (!rp->paused && now >= rp->last_time) {
+		// Hold the last picture at the end of the recording
+		replay_set_time(rp, rp->last_time);
+		rp->paused = 1;
+	}
+
+	Arena *arena = &st->poll_arenas[st->poll_arena];
+	arena_reset(arena);
+
+	Aircraft *aircraft_list = NULL;
+	int aircraft_count = 0;
+	if (replay_picture(rp, arena, (int64_t)now, &aircraft_list, &aircraft_count) < 0) {
+		return;
+	}
+	st->aircraft = aircraft_list;
+	st->aircraft_count = aircraft_count;
+	st->poll_arena ^= 1;
+	tracks_update(&st->tracks, st->temp_screen, st->aircraft, st->aircraft_count);
+
+	time_t t = (time_t)now;
+	struct tm tm;
+	gmtime_r(&t, &tm);
+	char when[32];
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%SZ", &tm);
+	snprintf(st->status, sizeof(st->status), "REPLAY %s %s%gx", when,
+	         rp->paused ? "paused " : "", rp->speed);
+
+	layout_aircraft(st, now, rp->paused ? 0.0 : rp->speed);
+}
+
+// Replay controls: +/- speed, space pause, [ ] seek five minutes
+static void replay_key(RadarState *st, char key) {
+	Replay *rp = &st->replay;
+	double now = replay_now(rp);
+
+	switch (key) {
+		case '+':
+			rp->speed = rp->speed * 2 > REPLAY_MAX_SPEED ? REPLAY_MAX_SPEED : rp->speed * 2;
+			break;
+		case '-':
+			rp->speed = rp->speed / 2 < 1.0 ? 1.0 : rp->speed / 2;
+			break;
+		case ' ':
+			rp->paused = !rp->paused;
+			if (!rp->paused && now >= rp->last_time) {
+				now = rp->first_time;
+			}
+			break;
+		case '[':
+			now -= 300;
+			tracks_clear(&st->tracks, st->temp_screen);
+			break;
+		case ']':
+			now += 300;
+			tracks_clear(&st->tracks, st->temp_screen);
+			break;
+		default:
+			return;
+	}
+	replay_set_time(rp, now);
+	replay_update(st);
+	if (key == '[' || key == ']') {
+		// The trail layer was cleared wholesale, not cell by cell
+		st->reveal_steps = NUM_ANGLES;
+	}
+}
+
+// Bin every cell of a width x height screen by sweep step (counting sort on angle)
+int build_sweep_table(SweepTable *table, int width, int height) {
+	int total = width * height;
+	int *start = calloc(NUM_ANGLES + 1, sizeof(int));
+	SweepCell *cells = malloc(total * sizeof(SweepCell));
+	uint16_t *step_of = malloc(total * sizeof(uint16_t));
+
+	if (!start || !cells || !step_of) {
+		free(start);
+		free(cells);
+		free(step_of);
+		return -1;
+	}
+
+	int center_x = width / 2;
+	int center_y = height / 2;
+
+	// Same angle convention as the ray sweep: theta = atan2(dy, dx) in cell space
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			double theta = atan2(y - center_y, x - center_x);
+			if (theta < 0) theta += 2 * M_PI;
+			int step = (int)(theta * NUM_ANGLES / (2 * M_PI));
+			if (step >= NUM_ANGLES) step = NUM_ANGLES - 1;
+			step_of[y * width + x] = step;
+			start[step + 1]++;
+		}
+	}
+
+	for (int s = 0; s < NUM_ANGLES; s++) {
+		start[s + 1] += start[s];
+	}
+
+	int *fill = malloc(NUM_ANGLES * sizeof(int));
+	if (!fill) {
+		free(start);
+		free(cells);
+		free(step_of);
+		return -1;
+	}
+	memcpy(fill, start, NUM_ANGLES * sizeof(int));
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			SweepCell *c = &cells[fill[step_of[y * width + x]]++];
+			c->x = x;
+			c->y = y;
+		}
+	}
+	free(fill);
+
+	free(table->start);
+	free(table->cells);
+	free(table->step_of);
+	table->width = width;
+	table->height = height;
+	table->start = start;
+	table->cells = cells;
+	table->step_of = step_of;
+	return 0;
+}
+
+void free_sweep_table(SweepTable *table) {
+	free(table->start);
+	free(table->cells);
+	free(table->step_of);
+	table->start = NULL;
+	table->cells = NULL;
+	table->step_of = NULL;
+}
+
+// Repaint the targets whose bearing falls in sweep step `step`
+static void targets_paint_step(RadarState *st, int step) {
+	TargetIndex *ti = &st->targets;
+	if (ti->start[step] == ti->start[step + 1]) {
+		return;
+	}
+
+	double dt = elapsed_ms(&ti->layout_wall) / 1000.0 * ti->speed;
+	for (int i = ti->start[step]; i < ti->start[step + 1]; i++) {
+		Target *t = &ti->targets[ti->order[i]];
+		uint32_t tag = TARGET_TAG(t->icao24);
+		if (t->is_shown) {
+			footprint_erase(st->screen, &st->renderer, ti, &t->shown, tag);
+			t->is_shown = 0;
+		}
+		if (t->has_layout) {
+			int x, y;
+			target_position(t, dt, st->temp_screen, &x, &y);
+			footprint_paint(st->screen, st->temp_screen, &st->renderer, ti, &t->layout,
+			                x - t->layout.x, y - t->layout.y, tag);
+			t->shown = footprint_moved(&t->layout, x - t->layout.x, y - t->layout.y);
+			t->is_shown = 1;
+		}
+		ti->paints++;
+	}
+}
+
+// Copy the queued trail cells of sweep step `step` to the screen
+static void reveal_queue_step(RadarState *st, int step) {
+	RevealQueue *q = &st->reveal;
+	int width = st->screen->width;
+
+	while (q->head[step] >= 0) {
+		int e = q->head[step];
+		int y = q->cell[e] / width, x = q->cell[e] % width;
+		if (st->screen->trail[y][x] != st->temp_screen->trail[y][x]) {
+			st->screen->trail[y][x] = st->temp_screen->trail[y][x];
+			mark_dirty(&st->renderer, LAYER_TRAILS, y, x);
+		}
+		q->head[step] = q->next[e];
+		q->next[e] = q->free_head;
+		q->free_head = e;
+	}
+}
+
+// Stamp the cells of sweep step `step` with a new tick, and mark the cells
+// whose afterglow changes band with it: the new wedge and one wedge per edge
+static void glow_step(RadarState *st, int step) {
+	Renderer *r = &st->renderer;
+	const SweepTable *table = &st->sweep;
+	const Matrix *screen = st->screen;
+
+	r->glow_tick++;
+	for (int i = table->start[step]; i < table->start[step + 1]; i++) {
+		r->glow_stamp[table->cells[i].y * r->width + table->cells[i].x] = r->glow_tick;
+	}
+	if (r->depth == DEPTH_MONO) {
+		return;
+	}
 
-					display_symbol(temp_screen, screen_x, screen_y);
-					display_slash(temp_screen, screen_x, screen_y);
-					display_info(temp_screen, screen_x, screen_y, ac->callsign, altitude_ft, speed_kts, ac->distance);
+	// With 16 colors all bands look alike: only the start and the end show
+	int last = r->depth == DEPTH_16 ? GLOW_BANDS - 1 : 0;
+	for (int b = -1; b < GLOW_BANDS; b++) {
+		if (b >= 0 && b < last) {
+			continue;
+		}
+		int s = b < 0 ? step : (step - glow_band_age[b] + NUM_ANGLES) % NUM_ANGLES;
+		for (int i = table->start[s]; i < table->start[s + 1]; i++) {
+			int x = table->cells[i].x;
+			int y = table->cells[i].y;
+			// Only blank dot cells show the glow
+			if (GLOW_DOT(x, y) && compose_cell(r, screen, y, x, LAYER_WEATHER) == CELL_BLANK) {
+				mark_dirty(r, LAYER_GLOW, y, x);
+			}
+		}
+	}
+}
+
+// Weather layer the screen shows: the contours in outline mode
+static inline const WeatherIntensity *shown_weather(const RadarState *st) {
+	return st->opts.outline ? st->outline : st->temp_screen->weather[0];
+}
+
+// Advance the beam: paint the targets and queued cells of each step it
+// passes, and copy whole wedges only while a weather update is revealed
+void sweep_steps(RadarState *st, uint64_t steps) {
+	Matrix *screen = st->screen;
+	Matrix *temp_screen = st->temp_screen;
+	const SweepTable *table = &st->sweep;
+	const WeatherIntensity *weather = shown_weather(st);
+
+	// After an overrun, one full revolution already covers everything
+	if (steps > NUM_ANGLES) {
+		steps = NUM_ANGLES;
+	}
+
+	for (uint64_t s = 0; s < steps; s++) {
+		int step = st->current_angle;
+		reveal_queue_step(st, step);
+		targets_paint_step(st, step);
+		if (st->renderer.glow) {
+			glow_step(st, step);
+		}
+
+		if (st->reveal_steps > 0) {
+			for (int i = table->start[step]; i < table->start[step + 1]; i++) {
+				int x = table->cells[i].x;
+				int y = table->cells[i].y;
+				WeatherIntensity w = weather[y * screen->width + x];
+				if (screen->trail[y][x] != temp_screen->trail[y][x]) {
+					screen->trail[y][x] = temp_screen->trail[y][x];
+					mark_dirty(&st->renderer, LAYER_TRAILS, y, x);
 				}
+				if (screen->weather[y][x] != w) {
+					screen->weather[y][x] = w;
+					mark_dirty(&st->renderer, LAYER_WEATHER, y, x);
+				}
+			}
+			st->reveal_steps--;
+		}
+
+		st->current_angle = (st->current_angle + 1) % NUM_ANGLES;
+		if (st->current_angle == 0 && !st->opts.no_nowcast) {
+			weather_advect(&st->weather_worker);
+		}
+	}
+}
+
+// Screen size from the terminal: one row is left free so the last newline cannot scroll
+void query_screen_size(int *height, int *width) {
+	struct winsize ws;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+		*height = ws.ws_row - 1;
+		*width = ws.ws_col;
+	} else {
+		// Not a terminal: keep the classic 120x240 layout
+		*height = 120;
+		*width = 240;
+	}
+
+	if (*height < MIN_SCREEN_HEIGHT) *height = MIN_SCREEN_HEIGHT;
+	if (*width < MIN_SCREEN_WIDTH) *width = MIN_SCREEN_WIDTH;
+	if (*height > MAX_SCREEN_DIM) *height = MAX_SCREEN_DIM;
+	if (*width > MAX_SCREEN_DIM) *width = MAX_SCREEN_DIM;
+}
+
+// Rebuild buffers, projection and sweep table for the current terminal size
+int resize_screen(RadarState *st) {
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	int height, width;
+	if (st->opts.headless) {
+		height = 120;
+		width = 240;
+	} else {
+		query_screen_size(&height, &width);
+	}
+
+	if (st->screen && st->screen->height == height && st->screen->width == width) {
+		return 0;
+	}
 
-				free(aircraft_list);
+	if (build_sweep_table(&st->sweep, width, height) < 0 ||
+	    renderer_resize(&st->renderer, height, width) < 0) {
+		fprintf(stderr, "Failed to allocate screen buffers\n");
+		return -1;
+	}
+
+	if (st->screen) free_matrix(st->screen);
+	if (st->temp_screen) free_matrix(st->temp_screen);
+	st->screen = create_matrix(height, width);
+	st->temp_screen = create_matrix(height, width);
+	if (!st->screen || !st->temp_screen) {
+		fprintf(stderr, "Failed to allocate screen buffers\n");
+		return -1;
+	}
+
+	// Redraw the layers for the new projection and show them at once,
+	// the sweep then carries on from where it was; a radar composite is
+	// resampled by the weather worker and revealed when it is ready
+	draw_weather_layer(st->temp_screen, &st->weather);
+	if (st->opts.outline) {
+		free(st->outline);
+		st->outline = malloc((size_t)width * height * sizeof(WeatherIntensity));
+		if (!st->outline) {
+			fprintf(stderr, "Failed to allocate screen buffers\n");
+			return -1;
+		}
+		outline_weather(st->outline, st->temp_screen->weather[0], width, height);
+	}
+	if (st->overlay.shape_count) {
+		uint8_t *cells = realloc(st->overlay_cells, (size_t)width * height);
+		if (!cells) {
+			fprintf(stderr, "Failed to allocate screen buffers\n");
+			return -1;
+		}
+		st->overlay_cells = cells;
+		overlay_rasterize(&st->overlay, cells, width, height);
+		// Panel text is not crossed by overlay lines
+		for (int panel = 0; panel < (st->overlay.area_count ? 2 : 1); panel++) {
+			int r0, r1, c0, c1;
+			if (hazard_panel_rect(height, width, panel, &r0, &r1, &c0, &c1)) {
+				for (int r = r0; r <= r1; r++) {
+					memset(cells + (size_t)r * width + c0, OVERLAY_NONE, c1 - c0 + 1);
+				}
 			}
-			
-			last_fetch_time = current_time;
 		}
-		
-		// Perform one sonar sweep step
-		double theta = (current_angle * 2 * M_PI) / num_angles;
-		
-		for (int radius = 0; radius <= max_radius; radius++) {
-			int x = center_x + (int)(radius * cos(theta));
-			int y = center_y + (int)(radius * sin(theta));
-			
-			if (x >= 0 && x < screen->width && y >= 0 && y < screen->height) {
-				screen->data[y][x] = temp_screen->data[y][x];
-				screen->weather[y][x] = temp_screen->weather[y][x];
+		st->renderer.overlay = cells;
+	}
+	if (st->opts.radar_dir) {
+		weather_request(&st->weather_worker, width, height, 0);
+	}
+	if (tracks_rasterize(&st->tracks, st->temp_screen) < 0) {
+		fprintf(stderr, "Failed to allocate screen buffers\n");
+		return -1;
+	}
+	// Nothing of the old screen survives; the layout clock carries on
+	if (targets_resize(&st->targets, height, width) < 0) {
+		fprintf(stderr, "Failed to allocate screen buffers\n");
+		return -1;
+	}
+	layout_aircraft(st, layout_clock(&st->targets), st->targets.speed);
+	reveal_queue_clear(&st->reveal);
+	for (int i = 0; i < height; i++) {
+		memcpy(st->screen->data[i], st->temp_screen->data[i], width * sizeof(char));
+		memcpy(st->screen->trail[i], st->temp_screen->trail[i], width * sizeof(char));
+		memcpy(st->screen->weather[i], shown_weather(st) + (size_t)i * width, width * sizeof(WeatherIntensity));
+	}
+	targets_mark_shown(&st->targets, st->screen, &st->renderer);
+
+	if (st->current_angle >= NUM_ANGLES) {
+		st->current_angle = 0;
+	}
+	st->reveal_steps = 0;
+
+	st->last_resize_ms = elapsed_ms(&t0);
+	if (st->last_resize_ms > st->max_resize_ms) {
+		st->max_resize_ms = st->last_resize_ms;
+	}
+	st->resize_count++;
+	return 0;
+}
+
+// Put the terminal into non-canonical, no-echo mode on the alternate screen
+static void terminal_enter(RadarState *st) {
+	if (st->stdin_fd >= 0 && tcgetattr(st->stdin_fd, &st->saved_termios) == 0) {
+		struct termios raw = st->saved_termios;
+		raw.c_lflag &= ~(ICANON | ECHO);  // keep ISIG so Ctrl+C still raises SIGINT
+		raw.c_cc[VMIN] = 0;
+		raw.c_cc[VTIME] = 0;
+		tcsetattr(st->stdin_fd, TCSANOW, &raw);
+		st->termios_saved = 1;
+	}
+	printf("\033[?1049h\033[?25l\033[2J");
+	fflush(stdout);
+}
+
+static void terminal_restore(RadarState *st) {
+	printf("%s\033[?25h\033[?1049l", COLOR_RESET);
+	fflush(stdout);
+	if (st->termios_saved) {
+		tcsetattr(st->stdin_fd, TCSANOW, &st->saved_termios);
+		st->termios_saved = 0;
+	}
+}
+
+static void handle_keys(RadarState *st) {
+	char keys[32];
+	ssize_t n = read(st->stdin_fd, keys, sizeof(keys));
+
+	for (ssize_t i = 0; i < n; i++) {
+		if (keys[i] == 'q' || keys[i] == 'Q') {
+			st->running = 0;
+		} else if (st->replaying) {
+			replay_key(st, keys[i]);
+		}
+	}
+}
+
+static void handle_signals(RadarState *st) {
+	struct signalfd_siginfo si;
+
+	while (read(st->signal_fd, &si, sizeof(si)) == sizeof(si)) {
+		switch (si.ssi_signo) {
+			case SIGINT:
+			case SIGTERM:
+				st->running = 0;
+				break;
+			case SIGWINCH:
+				// Coalesced: a burst of resize events costs one rebuild per frame
+				st->resize_pending = !st->opts.headless;
+				break;
+		}
+	}
+}
+
+// Create the fds and curl multi handle the event loop waits on
+int radar_init(RadarState *st, const RadarOptions *opts) {
+	memset(st, 0, sizeof(*st));
+	st->opts = *opts;
+	st->epfd = st->frame_fd = st->poll_fd = st->weather_fd = -1;
+	st->curl_timer_fd = st->signal_fd = st->stdin_fd = st->stop_fd = -1;
+
+	// Signals are delivered through signalfd only
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGWINCH);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+		perror("sigprocmask");
+		return -1;
+	}
+
+	st->epfd = epoll_create1(EPOLL_CLOEXEC);
+	st->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	st->frame_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	st->poll_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	st->weather_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	st->curl_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (st->epfd < 0 || st->signal_fd < 0 || st->frame_fd < 0 || st->poll_fd < 0 ||
+	    st->weather_fd < 0 || st->curl_timer_fd < 0) {
+		perror("event loop setup");
+		return -1;
+	}
+
+	add_epoll_fd(st->epfd, st->signal_fd, EPOLLIN);
+	add_epoll_fd(st->epfd, st->frame_fd, EPOLLIN);
+	add_epoll_fd(st->epfd, st->poll_fd, EPOLLIN);
+	add_epoll_fd(st->epfd, st->weather_fd, EPOLLIN);
+	add_epoll_fd(st->epfd, st->curl_timer_fd, EPOLLIN);
+
+	if (!opts->headless && isatty(STDIN_FILENO)) {
+		st->stdin_fd = STDIN_FILENO;
+		add_epoll_fd(st->epfd, st->stdin_fd, EPOLLIN);
+	}
+
+	if (opts->duration_s > 0) {
+		st->stop_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (st->stop_fd < 0) {
+			perror("timerfd_create");
+			return -1;
+		}
+		add_epoll_fd(st->epfd, st->stop_fd, EPOLLIN);
+		arm_timer(st->stop_fd, opts->duration_s * 1000L, 0);
+	}
+
+	// Started after the signal mask is set, so the threads inherit it
+	if (opts->history_dir && history_start(&st->history, opts->history_dir) < 0) {
+		return -1;
+	}
+	if (weather_start(&st->weather_worker, opts->radar_dir, !opts->no_nowcast) < 0) {
+		return -1;
+	}
+	add_epoll_fd(st->epfd, st->weather_worker.event_fd, EPOLLIN);
+
+	if (opts->overlay_count) {
+		struct timespec t0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (int i = 0; i < opts->overlay_count; i++) {
+			if (overlay_load(&st->overlay, opts->overlay_files[i]) < 0) {
+				return -1;
 			}
 		}
-		
-		// Print updated display with colors
-		int ret = system("clear");
-		(void)ret;
-		for (int i = 0; i < screen->height; i++) {
-			for (int j = 0; j < screen->width; j++) {
-				// Aircraft data takes priority (shown in white)
-				if (screen->data[i][j] != ' ') {
-					printf("%s%c%s", COLOR_RESET, screen->data[i][j], COLOR_RESET);
+		st->overlay.load_ms = elapsed_ms(&t0);
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (airspace_build(&st->airspace, &st->overlay) < 0) {
+			return -1;
+		}
+		st->airspace.build_ms = elapsed_ms(&t0);
+	}
+
+	if (opts->replay_dir) {
+		if (replay_open(&st->replay, opts->replay_dir) < 0) {
+			return -1;
+		}
+		st->replaying = 1;
+		st->replay.speed = opts->replay_speed;
+		replay_set_time(&st->replay, opts->replay_from >= 0 ? opts->replay_from : st->replay.first_time);
+	} else if (opts->snapshot_path &&
+	           snapshot_load(&st->snapshot, opts->snapshot_path, &st->weather) == 0) {
+		// Drawn by the first resize below, so the first frame already has a picture
+		st->aircraft = st->snapshot.aircraft;
+		st->aircraft_count = st->snapshot.aircraft_count;
+
+		time_t t = st->snapshot.saved_at;
+		struct tm tm;
+		gmtime_r(&t, &tm);
+		strftime(st->status, sizeof(st->status), "STALE since %Y-%m-%d %H:%M:%SZ", &tm);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &st->last_snapshot);
+
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+	st->multi = curl_multi_init();
+	if (!st->multi) {
+		fprintf(stderr, "Failed to initialize CURL multi handle\n");
+		return -1;
+	}
+	curl_multi_setopt(st->multi, CURLMOPT_SOCKETFUNCTION, curl_socket_cb);
+	curl_multi_setopt(st->multi, CURLMOPT_SOCKETDATA, st);
+	curl_multi_setopt(st->multi, CURLMOPT_TIMERFUNCTION, curl_timer_cb);
+	curl_multi_setopt(st->multi, CURLMOPT_TIMERDATA, st);
+
+	reveal_queue_clear(&st->reveal);
+	if (resize_screen(st) < 0) {
+		return -1;
+	}
+
+	arm_timer(st->frame_fd, FRAME_INTERVAL_MS, FRAME_INTERVAL_MS);
+	if (st->replaying) {
+		arm_timer(st->poll_fd, 0, REPLAY_TICK_MS);
+	} else {
+		arm_timer(st->poll_fd, 0, FETCH_INTERVAL_S * 1000L);
+	}
+	arm_timer(st->weather_fd, 0, WEATHER_FETCH_INTERVAL_S * 1000L);
+
+	st->renderer.sgr = SGR_UNKNOWN;
+	st->renderer.fd = opts->headless ? -1 : STDOUT_FILENO;
+	// The glow repaints cells on every sweep step, which a capped link can't afford
+	st->renderer.glow = opts->afterglow && opts->max_rate <= 0;
+	st->bandwidth.rate = opts->max_rate;
+	st->bandwidth.tokens = BANDWIDTH_MIN_CHUNK;
+	clock_gettime(CLOCK_MONOTONIC, &st->bandwidth.last_refill);
+	st->bandwidth.last_adjust = st->bandwidth.last_refill;
+	st->running = 1;
+	return 0;
+}
+
+static void close_fd(int fd) {
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+void radar_shutdown(RadarState *st) {
+	history_stop(&st->history);
+	weather_stop(&st->weather_worker);
+	if (st->replaying) {
+		replay_close(&st->replay);
+	}
+	if (st->live && st->opts.snapshot_path) {
+		snapshot_save(st->opts.snapshot_path, st->aircraft, st->aircraft_count, &st->weather);
+	}
+	snapshot_close(&st->snapshot);
+
+	if (st->aircraft_easy) {
+		if (st->aircraft_busy) {
+			curl_multi_remove_handle(st->multi, st->aircraft_easy);
+		}
+		curl_easy_cleanup(st->aircraft_easy);
+		st->aircraft_easy = NULL;
+	}
+	if (st->multi) {
+		curl_multi_cleanup(st->multi);
+	}
+	curl_global_cleanup();
+
+	if (st->screen) free_matrix(st->screen);
+	if (st->temp_screen) free_matrix(st->temp_screen);
+	free_sweep_table(&st->sweep);
+	free_tracks(&st->tracks);
+	free_targets(&st->targets);
+	free(st->outline);
+	free(st->overlay_cells);
+	free_airspace_mask(&st->airspace);
+	free_airspace_check(&st->airspace_check);
+	free_overlay(&st->overlay);
+	free_hazard(&st->hazard);
+	free_reveal_queue(&st->reveal);
+	arena_free_all(&st->poll_arenas[0]);
+	arena_free_all(&st->poll_arenas[1]);
+	free_renderer(&st->renderer);
+
+	close_fd(st->frame_fd);
+	close_fd(st->poll_fd);
+	close_fd(st->weather_fd);
+	close_fd(st->curl_timer_fd);
+	close_fd(st->signal_fd);
+	close_fd(st->stop_fd);
+	close_fd(st->epfd);
+}
+
+// Single-threaded event loop: everything is driven by epoll readiness
+void radar_run(RadarState *st) {
+	struct epoll_event events[16];
+	int running_handles;
+
+	while (st->running) {
+		int n = epoll_wait(st->epfd, events, 16, -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("epoll_wait");
+			break;
+		}
+
+		int frame_due = 0;
+		for (int i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == st->signal_fd) {
+				handle_signals(st);
+			} else if (fd == st->stop_fd) {
+				st->running = 0;
+			} else if (fd == st->stdin_fd) {
+				handle_keys(st);
+			} else if (fd == st->frame_fd) {
+				uint64_t steps = read_timer(fd);
+				if (steps > 0) {
+					sweep_steps(st, steps);
+					frame_due = 1;
 				}
-				// Weather radar shown underneath
-				else if (screen->weather[i][j] != WEATHER_NONE) {
-					const char *color = get_weather_color(screen->weather[i][j]);
-					const char *weather_char = get_weather_char(screen->weather[i][j]);
-					printf("%s%s%s", color, weather_char, COLOR_RESET);
+			} else if (fd == st->poll_fd) {
+				read_timer(fd);
+				if (st->replaying) {
+					replay_update(st);
+				} else {
+					start_aircraft_fetch(st);
 				}
-				else {
-					printf(" ");
+			} else if (fd == st->weather_fd) {
+				read_timer(fd);
+				weather_request(&st->weather_worker, st->temp_screen->width, st->temp_screen->height, 1);
+			} else if (fd == st->weather_worker.event_fd) {
+				if (weather_take(&st->weather_worker, st->temp_screen, &st->weather)) {
+					if (st->opts.outline) {
+						outline_weather(st->outline, st->temp_screen->weather[0],
+						                st->temp_screen->width, st->temp_screen->height);
+					}
+					st->reveal_steps = NUM_ANGLES;
 				}
+			} else if (fd == st->curl_timer_fd) {
+				read_timer(fd);
+				curl_multi_socket_action(st->multi, CURL_SOCKET_TIMEOUT, 0, &running_handles);
+				check_multi_info(st);
+			} else {
+				// Anything else is a socket owned by curl
+				int action = 0;
+				if (events[i].events & EPOLLIN) action |= CURL_CSELECT_IN;
+				if (events[i].events & EPOLLOUT) action |= CURL_CSELECT_OUT;
+				if (events[i].events & (EPOLLERR | EPOLLHUP)) action |= CURL_CSELECT_ERR;
+				curl_multi_socket_action(st->multi, fd, action, &running_handles);
+				check_multi_info(st);
 			}
-			printf("\n");
 		}
-		fflush(stdout);
-		
-		current_angle = (current_angle + 1) % num_angles;
-		usleep(7000);
+
+		if (st->resize_pending && st->running) {
+			st->resize_pending = 0;
+			if (resize_screen(st) == 0) {
+				frame_due = 1;
+			}
+		}
+
+		if (frame_due && st->running) {
+			hazard_update(st);
+			airspace_update(st);
+			if (st->bandwidth.rate > 0) {
+				// Deferred frames leave their dirty regions for a later one
+				st->renderer.budget = bandwidth_frame_budget(&st->bandwidth);
+				if (st->renderer.budget > 0) {
+					uint64_t before = st->renderer.bytes;
+					render_screen(&st->renderer, st->screen);
+					bandwidth_account(&st->bandwidth, &st->renderer, st->renderer.bytes - before);
+				}
+			} else {
+				render_screen(&st->renderer, st->screen);
+			}
+		}
+	}
+}
+
+// Parse a byte rate such as "20000", "20K", "20KB" or "1M" (bytes per second)
+static double parse_rate(const char *text) {
+	char *end;
+	double rate = strtod(text, &end);
+
+	if (end == text || rate <= 0) {
+		return -1;
+	}
+	if (*end == 'k' || *end == 'K') {
+		rate *= 1000;
+		end++;
+	} else if (*end == 'm' || *end == 'M') {
+		rate *= 1000000;
+		end++;
+	}
+	if (*end == 'b' || *end == 'B') {
+		end++;
+	}
+	if (strcmp(end, "/s") == 0) {
+		end += 2;
+	}
+	return *end == '\0' ? rate : -1;
+}
+
+static void print_usage(const char *prog) {
+	printf("Usage: %s [options]\n", prog);
+	printf("  -a, --airport ICAO    center the view on ICAO or on LAT,LON (default %s)\n", DEFAULT_AIRPORT);
+	printf("      --range NM        nautical miles to the nearer screen edge (default %.0f)\n", DEFAULT_RANGE_NM);
+	printf("  -r, --max-rate RATE   cap terminal output, e.g. 20K (bytes per second)\n");
+	printf("      --headless        render into a byte counter instead of the terminal\n");
+	printf("  -d, --duration SECS   exit after SECS seconds\n");
+	printf("      --history-dir DIR record every received state into DIR\n");
+	printf("      --replay DIR      play back history recorded in DIR instead of polling\n");
+	printf("      --from TIME       replay start, unix seconds or UTC YYYY-MM-DDTHH:MM[:SS]\n");
+	printf("      --speed X         replay speed, 1 to %.0f (default 1)\n", REPLAY_MAX_SPEED);
+	printf("      --snapshot FILE   warm-start snapshot (default ~/.cache/aircraft_display_radar.snap)\n");
+	printf("      --no-snapshot     neither show nor save a snapshot\n");
+	printf("      --radar-dir DIR   show the newest ODIM-HDF5 radar composite in DIR\n");
+	printf("      --afterglow       phosphor afterglow behind the sweep (not with --max-rate)\n");
+	printf("      --no-nowcast      hold weather still between refreshes\n");
+	printf("      --outline         draw weather as contour lines instead of shading\n");
+	printf("      --overlay FILE    draw airspace, runways and navaids from a GeoJSON file\n");
+	printf("                        (up to %d files)\n", OVERLAY_MAX_FILES);
+	printf("      --bench-labels N  time label placement for N synthetic aircraft and exit\n");
+	printf("      --bench-maxpool   check and time radar max-pooling and exit\n");
+	printf("      --bench-nowcast DIR  score and time the nowcast on the composites in DIR\n");
+	printf("      --bench-airspace FILE  check and time airspace classification on FILE\n");
+	printf("  -h, --help            show this help\n");
+}
+
+// Parse command line options; returns -1 on error, 1 when the program should just exit
+int parse_options(int argc, char **argv, RadarOptions *opts) {
+	static const struct option long_options[] = {
+		{"airport", required_argument, NULL, 'a'},
+		{"range", required_argument, NULL, 'K'},
+		{"max-rate", required_argument, NULL, 'r'},
+		{"headless", no_argument, NULL, 'H'},
+		{"duration", required_argument, NULL, 'd'},
+		{"history-dir", required_argument, NULL, 'S'},
+		{"replay", required_argument, NULL, 'R'},
+		{"from", required_argument, NULL, 'F'},
+		{"speed", required_argument, NULL, 'X'},
+		{"snapshot", required_argument, NULL, 'P'},
+		{"no-snapshot", no_argument, NULL, 'N'},
+		{"radar-dir", required_argument, NULL, 'W'},
+		{"afterglow", no_argument, NULL, 'G'},
+		{"no-nowcast", no_argument, NULL, 'O'},
+		{"outline", no_argument, NULL, 'L'},
+		{"overlay", required_argument, NULL, 'A'},
+		{"bench-labels", required_argument, NULL, 'B'},
+		{"bench-maxpool", no_argument, NULL, 'M'},
+		{"bench-nowcast", required_argument, NULL, 'C'},
+		{"bench-airspace", required_argument, NULL, 'Y'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	memset(opts, 0, sizeof(*opts));
+	opts->replay_from = -1;
+	opts->replay_speed = 1.0;
+	opts->snapshot_path = default_snapshot_path();
+	opts->airport = DEFAULT_AIRPORT;
+	opts->range_nm = DEFAULT_RANGE_NM;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "a:r:d:h", long_options, NULL)) != -1) {
+		switch (c) {
+			case 'a':
+				opts->airport = optarg;
+				break;
+			case 'K':
+				opts->range_nm = atof(optarg);
+				break;
+			case 'r':
+				opts->max_rate = parse_rate(optarg);
+				if (opts->max_rate <= 0) {
+					fprintf(stderr, "Invalid rate: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'H':
+				opts->headless = 1;
+				break;
+			case 'd':
+				opts->duration_s = atoi(optarg);
+				break;
+			case 'S':
+				opts->history_dir = optarg;
+				break;
+			case 'R':
+				opts->replay_dir = optarg;
+				break;
+			case 'F':
+				opts->replay_from = parse_time(optarg);
+				if (opts->replay_from < 0) {
+					fprintf(stderr, "Invalid time: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'P':
+				opts->snapshot_path = optarg;
+				break;
+			case 'N':
+				opts->snapshot_path = NULL;
+				break;
+			case 'W':
+#ifdef HAVE_HDF5
+				opts->radar_dir = optarg;
+				break;
+#else
+				fprintf(stderr, "--radar-dir needs a build with HDF5 support (make HDF5=1)\n");
+				return -1;
+#endif
+			case 'G':
+				opts->afterglow = 1;
+				break;
+			case 'B':
+				opts->bench_labels = atoi(optarg);
+				break;
+			case 'M':
+				opts->bench_maxpool = 1;
+				break;
+			case 'C':
+#ifdef HAVE_HDF5
+				opts->bench_nowcast = optarg;
+				break;
+#else
+				fprintf(stderr, "--bench-nowcast needs a build with HDF5 support (make HDF5=1)\n");
+				return -1;
+#endif
+			case 'Y':
+				opts->bench_airspace = optarg;
+				break;
+			case 'O':
+				opts->no_nowcast = 1;
+				break;
+			case 'L':
+				opts->outline = 1;
+				break;
+			case 'A':
+				if (opts->overlay_count == OVERLAY_MAX_FILES) {
+					fprintf(stderr, "At most %d overlay files\n", OVERLAY_MAX_FILES);
+					return -1;
+				}
+				opts->overlay_files[opts->overlay_count++] = optarg;
+				break;
+			case 'X':
+				opts->replay_speed = atof(optarg);
+				if (opts->replay_speed < 1.0 || opts->replay_speed > REPLAY_MAX_SPEED) {
+					fprintf(stderr, "Invalid speed: %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'h':
+				print_usage(argv[0]);
+				return 1;
+			default:
+				print_usage(argv[0]);
+				return -1;
+		}
+	}
+	return 0;
+}
+
+// Time label placement on synthetic traffic packed around the airport, like a busy approach
+int bench_labels(int count) {
+	Aircraft *aircraft = calloc(count, sizeof(Aircraft));
+	Matrix *matrix = create_matrix(120, 240);
+	if (!aircraft || !matrix) {
+		free(aircraft);
+		if (matrix) free_matrix(matrix);
+		return 1;
+	}
+
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		// Denser toward the center: radius grows with the square of a uniform draw
+		double u = (double)rand() / RAND_MAX;
+		double angle = 2 * M_PI * rand() / RAND_MAX;
+		double r_nm = view.range_nm * u * u;
+		Aircraft *ac = &aircraft[i];
+		snprintf(ac->callsign, sizeof(ac->callsign), "SWR%03d", i % 1000);
+		ac->icao24 = 0x4B0000 + i;
+		unproject(r_nm * cos(angle), r_nm * sin(angle), &ac->latitude, &ac->longitude);
+		ac->altitude = 900 + rand() % 11000;
+		ac->velocity = 80 + rand() % 170;
+		ac->distance = calculate_distance(view.lat, view.lon, ac->latitude, ac->longitude);
+	}
+
+	// The first layer formats every label, later ones find them in the cache
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	draw_aircraft_layer(matrix, aircraft, count, weather_source(NULL), "", 1);
+	double cold_us = elapsed_ms(&t0) * 1000.0;
+
+	const int rounds = 200;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < rounds; i++) {
+		draw_aircraft_layer(matrix, aircraft, count, weather_source(NULL), "", 1);
+	}
+	double us = elapsed_ms(&t0) * 1000.0 / rounds;
+
+	const LabelPlacer *lp = &label_placer;
+	printf("Labels for %d aircraft on %dx%d: %.1f us per layer (first layer %.1f us)\n",
+	       count, matrix->width, matrix->height, us, cold_us);
+	printf("  %d beside the symbol, %d on a longer leader, %d callsign only, %d dropped\n",
+	       lp->placed, lp->leadered, lp->reduced, lp->dropped);
+
+	// The per-frame weather check over the same traffic and a simulated field
+	WeatherHazard wh;
+	WeatherField field;
+	memset(&wh, 0, sizeof(wh));
+	fetch_weather_data(&field);
+	draw_weather_layer(matrix, &field);
+	if (hazard_rebuild(&wh, lp, aircraft, 0) == 0) {
+		const int frames = 2000;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (int i = 0; i < frames; i++) {
+			hazard_check(&wh, matrix, i * 0.007);
+		}
+		printf("Weather check for %d aircraft: %.2f us per frame, %d in heavy weather\n",
+		       wh.count, elapsed_ms(&t0) * 1000.0 / frames, wh.hit_count);
+	}
+	free_hazard(&wh);
+
+	free_matrix(matrix);
+	free(aircraft);
+	return 0;
+}
+
+// Check the max-pool kernel against the scalar reference on a synthetic
+// composite the size of the Swiss CCS4 grid, then time both
+int bench_maxpool(void) {
+	const int width = 710, height = 640;
+	uint8_t *grid = malloc((size_t)width * height);
+	uint8_t *fast = malloc((size_t)width * height);
+	uint8_t *ref = malloc((size_t)width * height);
+	if (!grid || !fast || !ref) {
+		free(grid);
+		free(fast);
+		free(ref);
+		return 1;
+	}
+
+	// Scattered showers: blobs of decreasing intensity on a dry background
+	srand(1);
+	memset(grid, WEATHER_NONE, (size_t)width * height);
+	for (int i = 0; i < 60; i++) {
+		int cx = rand() % width, cy = rand() % height, r = 3 + rand() % 25;
+		for (int y = cy - r; y <= cy + r; y++) {
+			for (int x = cx - r; x <= cx + r; x++) {
+				int d = (int)sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
+				if (x >= 0 && x < width && y >= 0 && y < height && d <= r) {
+					uint8_t b = (uint8_t)(WEATHER_EXTREME * (r - d) / r + (rand() % 2));
+					grid[(size_t)y * width + x] = b > WEATHER_EXTREME ? WEATHER_EXTREME : b;
+				}
+			}
+		}
+	}
+
+	// Every level, and odd sizes that leave a scalar tail and a lone last row
+	int mismatches = 0;
+	const int sizes[][2] = {{710, 640}, {709, 639}, {355, 320}, {97, 33}, {3, 1}};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		int w = sizes[i][0], h = sizes[i][1];
+		maxpool2(fast, grid, w, h);
+		maxpool2_scalar(ref, grid, w, h);
+		mismatches += memcmp(fast, ref, (size_t)((w + 1) / 2) * ((h + 1) / 2)) != 0;
+	}
+
+	const int rounds = 2000;
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < rounds; i++) {
+		maxpool2(fast, grid, width, height);
+	}
+	double fast_us = elapsed_ms(&t0) * 1000.0 / rounds;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < rounds; i++) {
+		maxpool2_scalar(ref, grid, width, height);
+	}
+	double ref_us = elapsed_ms(&t0) * 1000.0 / rounds;
+
+#if defined(__AVX2__)
+	const char *kernel = "AVX2";
+#elif defined(__SSE2__)
+	const char *kernel = "SSE2";
+#else
+	const char *kernel = "scalar";
+#endif
+	printf("Max-pool 2x2 of a %dx%d grid: %.1f us %s, %.1f us scalar reference\n",
+	       width, height, fast_us, kernel, ref_us);
+	printf("  %s the scalar reference\n", mismatches ? "MISMATCH against" : "matches");
+
+	free(grid);
+	free(fast);
+	free(ref);
+	return mismatches != 0;
+}
+
+// Feed the composites in dir through the nowcast in name order, as the
+// worker would, and score each frame's forecast from the two before it
+// against simply holding the last frame still
+int bench_nowcast(const char *dir) {
+	const int width = 240, height = 64;
+	DIR *d = opendir(dir);
+	if (!d) {
+		fprintf(stderr, "nowcast: cannot open %s: %s\n", dir, strerror(errno));
+		return 1;
+	}
+	char **names = NULL;
+	int count = 0;
+	struct dirent *de;
+	while ((de = readdir(d))) {
+		size_t len = strlen(de->d_name);
+		if (len > 3 && strcmp(de->d_name + len - 3, ".h5") == 0) {
+			char **ptr = realloc(names, (count + 1) * sizeof(char *));
+			if (!ptr) break;
+			names = ptr;
+			names[count++] = strdup(de->d_name);
+		}
+	}
+	closedir(d);
+	qsort(names, count, sizeof(char *), compare_names);
+
+	RadarGrid grid;
+	RemapTable remap;
+	Nowcast nc;
+	memset(&grid, 0, sizeof(grid));
+	memset(&remap, 0, sizeof(remap));
+	memset(&nc, 0, sizeof(nc));
+	size_t cells = (size_t)width * height;
+	WeatherIntensity *layer = malloc(cells * sizeof(WeatherIntensity));
+	WeatherIntensity *forecast = malloc(cells * sizeof(WeatherIntensity));
+
+	int frames = 0, forecasts = 0, estimates = 0;
+	double estimate_ms = 0, advect_ms = 0;
+	long advect_err = 0, still_err = 0;
+	for (int i = 0; i < count && layer && forecast; i++) {
+		char path[PATH_MAX];
+		struct stat sb;
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		if (radar_decode(path, &grid) < 0) {
+			continue;
+		}
+		if (grid.time == 0 && stat(path, &sb) == 0) {
+			grid.time = sb.st_mtime;
+		}
+		RemapKey key;
+		remap_key(&key, width, height, &grid);
+		const uint8_t *band = radar_pool(&grid, key.level);
+		if (!band || remap_prepare(&remap, &key, NULL) < 0) {
+			continue;
+		}
+		remap_apply(layer, &remap, band);
+		frames++;
+
+		struct timespec t0;
+		if (nc.frames == 2 && grid.time > nc.cur_time) {
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			nowcast_advect(&nc, forecast, difftime(grid.time, nc.cur_time));
+			advect_ms += elapsed_ms(&t0);
+			for (size_t c = 0; c < cells; c++) {
+				advect_err += abs((int)forecast[c] - (int)layer[c]);
+				still_err += abs((int)nc.cur[c] - (int)layer[c]);
+			}
+			forecasts++;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		nowcast_push(&nc, layer, width, height, grid.time);
+		if (nc.frames == 2) {
+			estimate_ms += elapsed_ms(&t0);
+			estimates++;
+		}
+	}
+
+	printf("Nowcast on %d composites from %s at %dx%d\n", frames, dir, width, height);
+	if (estimates > 0) {
+		printf("  motion estimate %.2f ms, %d of %d blocks moving at the end\n",
+		       estimate_ms / estimates, nc.moving, NOWCAST_BLOCKS_X * NOWCAST_BLOCKS_Y);
+	}
+	if (forecasts > 0) {
+		printf("  advection %.3f ms; mean band error over %d forecasts: %.4f advected, %.4f held still\n",
+		       advect_ms / forecasts, forecasts,
+		       (double)advect_err / ((double)forecasts * cells), (double)still_err / ((double)forecasts * cells));
+	} else {
+		printf("  fewer than three composites, nothing to score\n");
+	}
+
+	for (int i = 0; i < count; i++) {
+		free(names[i]);
+	}
+	free(names);
+	free(layer);
+	free(forecast);
+	free_nowcast(&nc);
+	free_remap(&remap);
+	free_radar_grid(&grid);
+	return forecasts > 0 ? 0 : 1;
+}
+
+// Check the airspace mask against testing every ring of every area, on
+// random positions and altitudes over the areas of a GeoJSON file, and time both
+int bench_airspace(const char *path) {
+	Overlay ov;
+	AirspaceMask am;
+	memset(&ov, 0, sizeof(ov));
+	memset(&am, 0, sizeof(am));
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (overlay_load(&ov, path) < 0) {
+		return 1;
+	}
+	double load_ms = elapsed_ms(&t0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (ov.area_count == 0 || airspace_build(&am, &ov) < 0) {
+		fprintf(stderr, "%s has no airspace areas\n", path);
+		free_overlay(&ov);
+		return 1;
+	}
+	double build_ms = elapsed_ms(&t0);
+
+	const int count = 100000;
+	double *lat = malloc(count * sizeof(double));
+	double *lon = malloc(count * sizeof(double));
+	double *alt = malloc(count * sizeof(double));
+	int *area = malloc(count * sizeof(int));
+	if (!lat || !lon || !alt || !area) {
+		free(lat);
+		free(lon);
+		free(alt);
+		free(area);
+		free_airspace_mask(&am);
+		free_overlay(&ov);
+		return 1;
+	}
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		lat[i] = am.lat0 + am.cell_lat * am.ny * rand() / RAND_MAX;
+		lon[i] = am.lon0 + am.cell_lon * am.nx * rand() / RAND_MAX;
+		alt[i] = rand() % 25000;
 	}
 
-	free_matrix(screen);
-	free_matrix(temp_screen);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	int inside = 0;
+	for (int i = 0; i < count; i++) {
+		area[i] = airspace_lookup(&am, &ov, lat[i], lon[i], alt[i]);
+		inside += area[i] >= 0;
+	}
+	double fast_ns = elapsed_ms(&t0) * 1e6 / count;
+
+	// The reference walks every edge, so it only checks a sample of a large file
+	int checked = ov.point_count > 100000 ? 1000 : count;
+	int mismatches = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < checked; i++) {
+		mismatches += airspace_lookup_slow(&ov, lat[i], lon[i], alt[i]) != area[i];
+	}
+	double ref_ns = elapsed_ms(&t0) * 1e6 / checked;
+
+	printf("Airspace: %d areas, %d points, loaded in %.1f ms\n", ov.area_count, ov.point_count, load_ms);
+	printf("Mask: %dx%d cells, %d entries, built in %.1f ms\n", am.nx, am.ny, am.entry_count, build_ms);
+	printf("Classify: %.0f ns per aircraft (every ring: %.0f ns), %d of %d inside an area\n",
+	       fast_ns, ref_ns, inside, count);
+	printf("Mismatches: %d of %d checked\n", mismatches, checked);
+
+	free(lat);
+	free(lon);
+	free(alt);
+	free(area);
+	free_airspace_mask(&am);
+	free_overlay(&ov);
+	return mismatches ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+	RadarOptions opts;
+	int ret = parse_options(argc, argv, &opts);
+	if (ret != 0) {
+		return ret < 0 ? 1 : 0;
+	}
+	if (view_init(opts.airport, opts.range_nm) < 0) {
+		return 1;
+	}
+	if (opts.bench_labels > 0) {
+		return bench_labels(opts.bench_labels);
+	}
+	if (opts.bench_maxpool) {
+		return bench_maxpool();
+	}
+	if (opts.bench_nowcast) {
+		return bench_nowcast(opts.bench_nowcast);
+	}
+	if (opts.bench_airspace) {
+		return bench_airspace(opts.bench_airspace);
+	}
+
+	printf("ADS-B Aircraft Display with MeteoSwiss Weather Radar - %s (%s)\n", view.icao, view.name);
+	printf("Range: %.0f nautical miles\n", view.range_nm);
+	if (opts.radar_dir) {
+		printf("Weather data: ODIM-HDF5 radar composites from %s\n", opts.radar_dir);
+	} else {
+		printf("Weather data: Simulated radar (Source: MeteoSwiss)\n");
+	}
+	printf("================================================================================\n\n");
+	if (opts.replay_dir) {
+		printf("Replaying recorded traffic from %s...\n\n", opts.replay_dir);
+	} else {
+		printf("Connecting to OpenSky Network API...\n\n");
+	}
+
+	RadarState st;
+	if (radar_init(&st, &opts) < 0) {
+		radar_shutdown(&st);
+		return 1;
+	}
+
+	struct timespec started;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+
+	if (!opts.headless) terminal_enter(&st);
+	radar_run(&st);
+	if (!opts.headless) terminal_restore(&st);
+
+	if (st.overlay.files) {
+		printf("Overlay: %d shapes, %d points from %d files, loaded in %.1f ms\n",
+		       st.overlay.shape_count, st.overlay.point_count, st.overlay.files, st.overlay.load_ms);
+	}
+	if (st.overlay.area_count) {
+		printf("Airspace: %d areas, %dx%d mask built in %.1f ms, %llu aircraft classified (%.2f us each)\n",
+		       st.overlay.area_count, st.airspace.nx, st.airspace.ny, st.airspace.build_ms,
+		       (unsigned long long)st.airspace_check.classified,
+		       st.airspace_check.classified ? st.airspace_check.classify_ms * 1000.0 / st.airspace_check.classified : 0.0);
+	}
+	if (st.resize_count > 1) {
+		printf("Screen rebuilds: %d, last %.2f ms, max %.2f ms\n",
+		       st.resize_count, st.last_resize_ms, st.max_resize_ms);
+	}
+	printf("Frames: %llu drawn, %llu idle, %.0f bytes per drawn frame\n",
+	       (unsigned long long)st.renderer.frames, (unsigned long long)st.renderer.idle_frames,
+	       st.renderer.frames ? (double)st.renderer.bytes / st.renderer.frames : 0.0);
+	printf("Damaged row spans:");
+	for (int l = 0; l < LAYER_COUNT; l++) {
+		printf("%s %s %llu", l ? "," : "", layer_names[l], (unsigned long long)st.renderer.layer_spans[l]);
+	}
+	printf("\n");
+	if (opts.headless || opts.max_rate > 0) {
+		double secs = elapsed_ms(&started) / 1000.0;
+		printf("Output: %llu bytes in %.1f s (%.0f bytes/s), %llu frames deferred, %d color depth changes\n",
+		       (unsigned long long)st.renderer.bytes, secs, secs > 0 ? st.renderer.bytes / secs : 0.0,
+		       (unsigned long long)st.bandwidth.deferred_frames, st.bandwidth.depth_changes);
+	}
+
+	radar_shutdown(&st);
+
+	if (opts.history_dir) {
+		printf("History: %llu states written (%llu bytes), %llu dropped\n",
+		       (unsigned long long)st.history.written, (unsigned long long)st.history.bytes,
+		       (unsigned long long)st.history.dropped);
+	}
+	if (st.replaying) {
+		printf("Replay: %zu blocks indexed, %llu updates, %.1f blocks decoded per update\n",
+		       st.replay.block_count, (unsigned long long)st.replay.updates,
+		       st.replay.updates ? (double)st.replay.blocks_decoded / st.replay.updates : 0.0);
+	}
 	return 0;
-}
\ No newline at end of file
+}